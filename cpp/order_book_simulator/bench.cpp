@@ -0,0 +1,441 @@
+/**
+ * @file bench.cpp
+ * @brief Mixed-workload benchmark: production-like order flow through OrderBook, per profile
+ *
+ * A WorkloadGenerator produces adds, cancels, modifies and market orders in
+ * configurable ratios, with prices drawn as a distance from the touch, sizes
+ * from a log-normal distribution and arrival times from a Poisson or Hawkes
+ * (self-exciting) process. Generation runs against a live reference book, so
+ * cancels and modifies name orders that are actually resting; the book is
+ * deterministic, and replaying the recorded flow into a fresh book reproduces
+ * the same states.
+ *
+ * Each profile is replayed twice: into an OrderBook for throughput and into a
+ * TimedOrderBook for per-operation latency percentiles.
+ *
+ * Usage:
+ *   ./bench [--profile NAME] [--messages N] [--seed N] [--pace SPEED] [--csv PREFIX] [--list]
+ *
+ * Compile: g++ -std=c++17 -O3 -pthread -o bench bench.cpp
+ */
+
+#include "orderbook.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+/**
+ * @struct WorkloadProfile
+ * @brief Message mix, price, size and arrival parameters of a synthetic order flow
+ *
+ * The four message weights need not sum to 1; they are normalized. Arrivals
+ * average `rate` messages per second. With `branching` > 0 they follow a
+ * Hawkes process whose events each raise the intensity by `branching` /
+ * `decay_us` per microsecond, decaying with time constant `decay_us`, so
+ * messages cluster into bursts while the mean rate stays `rate`.
+ */
+struct WorkloadProfile {
+    std::string name;
+    double add = 0.5;
+    double cancel = 0.4;
+    double modify = 0.08;
+    double market = 0.02;
+
+    double depth_ticks = 2.0;      // Mean distance of a passive add behind its own touch (geometric)
+    double cross = 0.02;           // Fraction of adds priced through the opposite touch
+    double reprice = 0.4;          // Fraction of modifies that move price (the rest reduce size in place)
+    double recent_bias = 0.75;     // Fraction of cancels and modifies aimed at the 32 newest live orders
+
+    double size_median = 200.0;    // Log-normal order size, rounded to whole lots
+    double size_sigma = 0.8;
+    uint64_t lot = 100;
+
+    double rate = 1e6;             // Mean messages per second
+    double branching = 0.0;        // Hawkes branching ratio in [0, 1); 0 = Poisson
+    double decay_us = 50.0;
+
+    size_t seed_orders = 20000;    // Passive adds that build the book before the measured flow
+    size_t max_live = 200000;      // Adds turn into cancels beyond this many tracked orders
+};
+
+/**
+ * @brief The standard profiles run by default
+ *
+ * - market_making: ~95% cancels and modifies within a tick or two of the touch, bursty
+ * - equities: adds and deletes dominate, a few marketable orders, Poisson
+ * - aggressive: many marketable limits and market orders sweeping levels, strongly clustered
+ * - deep_queues: passive adds spread over many levels with few cancels, long queues
+ */
+static std::vector<WorkloadProfile> standardProfiles() {
+    std::vector<WorkloadProfile> profiles(4);
+
+    WorkloadProfile& mm = profiles[0];
+    mm.name = "market_making";
+    mm.add = 0.045; mm.cancel = 0.04; mm.modify = 0.91; mm.market = 0.005;
+    mm.depth_ticks = 1.0; mm.cross = 0.01; mm.reprice = 0.6; mm.recent_bias = 0.9;
+    mm.size_median = 100.0; mm.size_sigma = 0.5;
+    mm.rate = 2e6; mm.branching = 0.7; mm.decay_us = 20.0;
+
+    WorkloadProfile& eq = profiles[1];
+    eq.name = "equities";
+    eq.add = 0.48; eq.cancel = 0.44; eq.modify = 0.06; eq.market = 0.02;
+    eq.depth_ticks = 3.0; eq.cross = 0.03;
+
+    WorkloadProfile& ag = profiles[2];
+    ag.name = "aggressive";
+    ag.add = 0.6; ag.cancel = 0.3; ag.modify = 0.04; ag.market = 0.06;
+    ag.depth_ticks = 2.0; ag.cross = 0.15;
+    ag.size_median = 400.0; ag.size_sigma = 1.2;
+    ag.branching = 0.9; ag.decay_us = 100.0;
+
+    WorkloadProfile& dq = profiles[3];
+    dq.name = "deep_queues";
+    dq.add = 0.7; dq.cancel = 0.25; dq.modify = 0.04; dq.market = 0.01;
+    dq.depth_ticks = 20.0; dq.cross = 0.01;
+    dq.seed_orders = 100000;
+
+    return profiles;
+}
+
+/**
+ * @struct Workload
+ * @brief Recorded flow: the first `seed` requests build the book and are not measured
+ */
+struct Workload {
+    std::vector<OrderRequest> requests;
+    std::vector<uint64_t> arrivals;  // Arrival time of each request, ns from the first
+    size_t seed = 0;
+    uint64_t counts[4] = {};         // Measured requests by type: add, cancel, modify, market
+};
+
+/**
+ * @class WorkloadGenerator
+ * @brief Draws a Workload for a profile against a reference OrderBook
+ *
+ * Prices are placed relative to the reference book's current touch; cancels
+ * and modifies pick from the generator's live orders, skipping any the book
+ * has since filled. Order IDs are assigned here and sent with
+ * addOrderTicksWithId, so replays need no ID mapping.
+ */
+class WorkloadGenerator {
+private:
+    const WorkloadProfile& profile;
+    std::mt19937_64 rng;
+    OrderBook book;
+    std::vector<uint64_t> live;  // Order IDs that rested when added; filled ones are pruned lazily
+    uint64_t next_id = 1;
+
+    // Arrival process state
+    double now_ns = 0.0;
+    double excess = 0.0;  // Hawkes intensity above baseline, per ns
+
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    std::lognormal_distribution<double> size_dist;
+    std::geometric_distribution<int> depth_dist;
+    std::discrete_distribution<int> kind_dist;
+
+    enum { ADD, CANCEL, MODIFY, MARKET };
+
+    uint64_t drawSize() {
+        double lots = std::round(size_dist(rng) / static_cast<double>(profile.lot));
+        return std::max<uint64_t>(1, static_cast<uint64_t>(lots)) * profile.lot;
+    }
+
+    /**
+     * @brief Next arrival in ns: exponential gaps, or Ogata thinning for the Hawkes intensity
+     */
+    uint64_t nextArrival() {
+        double rate_ns = profile.rate * 1e-9;
+        if (profile.branching <= 0.0) {
+            now_ns += std::exponential_distribution<double>(rate_ns)(rng);
+            return static_cast<uint64_t>(now_ns);
+        }
+        double beta = 1.0 / (profile.decay_us * 1e3);
+        double alpha = profile.branching * beta;
+        double baseline = rate_ns * (1.0 - profile.branching);
+        while (true) {
+            // Intensity only decays until the next event, so its current value bounds it
+            double bound = baseline + excess;
+            double gap = std::exponential_distribution<double>(bound)(rng);
+            now_ns += gap;
+            excess *= std::exp(-beta * gap);
+            if (unit(rng) * bound <= baseline + excess) {
+                excess += alpha;
+                return static_cast<uint64_t>(now_ns);
+            }
+        }
+    }
+
+    // Own-side touch for an order of `side`, falling back to the other side or the reference
+    Price touch(Side side) const {
+        const Instrument& inst = book.getInstrument();
+        double bid = book.getBestBid(), ask = book.getBestAsk();
+        if (side == Side::BUY) {
+            if (bid > 0.0) return inst.toTicks(bid);
+            return ask > 0.0 ? inst.toTicks(ask) - 1 : inst.toTicks(inst.reference_price) - 1;
+        }
+        if (ask > 0.0) return inst.toTicks(ask);
+        return bid > 0.0 ? inst.toTicks(bid) + 1 : inst.toTicks(inst.reference_price) + 1;
+    }
+
+    /**
+     * @brief Position in `live` of an order to cancel or modify, biased toward the newest;
+     *        live.size() if none is left
+     */
+    size_t pickLive() {
+        while (!live.empty()) {
+            size_t recent = std::min<size_t>(live.size(), 32);
+            size_t k = unit(rng) < profile.recent_bias ? live.size() - 1 - rng() % recent : rng() % live.size();
+            if (book.findOrder(live[k])) return k;
+            live[k] = live.back();
+            live.pop_back();
+        }
+        return live.size();
+    }
+
+    // Apply to the reference book and record
+    void emit(Workload& out, const OrderRequest& request) {
+        if (request.kind == OrderRequest::Kind::NEW) {
+            bool rested = book.addOrderTicksWithId(request.order_id, request.side, request.type, request.price,
+                                                   request.quantity, request.options) &&
+                          book.findOrder(request.order_id);
+            if (rested) live.push_back(request.order_id);
+        } else if (request.kind == OrderRequest::Kind::CANCEL) {
+            book.cancelOrder(request.order_id);
+        } else {
+            book.modifyOrderTicks(request.order_id, request.price, request.quantity);
+        }
+        out.requests.push_back(request);
+        out.arrivals.push_back(nextArrival());
+    }
+
+    OrderRequest add(bool passive) {
+        Side side = (rng() & 1) ? Side::BUY : Side::SELL;
+        Side contra = side == Side::BUY ? Side::SELL : Side::BUY;
+        Price price;
+        if (!passive && unit(rng) < profile.cross) {
+            Price through = rng() % 3;
+            price = side == Side::BUY ? touch(contra) + through : touch(contra) - through;
+        } else {
+            Price behind = depth_dist(rng);
+            price = side == Side::BUY ? touch(side) - behind : touch(side) + behind;
+            // Never cross by accident when the spread is a single tick
+            price = side == Side::BUY ? std::min(price, touch(contra) - 1) : std::max(price, touch(contra) + 1);
+        }
+        return {OrderRequest::Kind::NEW, side, OrderType::LIMIT, 0, next_id++, price, drawSize(), {}};
+    }
+
+public:
+    WorkloadGenerator(const WorkloadProfile& profile_, const Instrument& instrument_, uint64_t seed)
+        : profile(profile_),
+          rng(seed),
+          book(instrument_),
+          size_dist(std::log(profile_.size_median), profile_.size_sigma),
+          depth_dist(1.0 / (1.0 + profile_.depth_ticks)),
+          kind_dist({profile_.add, profile_.cancel, profile_.modify, profile_.market}) {}
+
+    Workload generate(size_t n_messages) {
+        Workload out;
+        out.requests.reserve(profile.seed_orders + n_messages);
+        out.arrivals.reserve(profile.seed_orders + n_messages);
+        for (size_t i = 0; i < profile.seed_orders; ++i) emit(out, add(true));
+        out.seed = out.requests.size();
+        now_ns = 0.0;
+        out.arrivals.assign(out.seed, 0);
+
+        for (size_t i = 0; i < n_messages; ++i) {
+            int kind = kind_dist(rng);
+            if (kind == ADD && live.size() >= profile.max_live) kind = CANCEL;
+            uint64_t target = 0;
+            if (kind == CANCEL || kind == MODIFY) {
+                size_t k = pickLive();
+                if (k == live.size()) {
+                    kind = ADD;
+                } else {
+                    target = live[k];
+                    if (kind == CANCEL) {
+                        live[k] = live.back();
+                        live.pop_back();
+                    }
+                }
+            }
+            ++out.counts[kind];
+
+            if (kind == ADD) {
+                emit(out, add(false));
+            } else if (kind == MARKET) {
+                Side side = (rng() & 1) ? Side::BUY : Side::SELL;
+                emit(out, {OrderRequest::Kind::NEW, side, OrderType::MARKET, 0, next_id++, 0, drawSize(), {}});
+            } else if (kind == CANCEL) {
+                emit(out, {OrderRequest::Kind::CANCEL, Side::BUY, OrderType::LIMIT, 0, target, 0, 0, {}});
+            } else {
+                const Order& order = *book.findOrder(target);
+                Price price = order.price;
+                uint64_t quantity = order.quantity + order.hidden_quantity;
+                uint64_t lots = quantity / profile.lot;
+                if (lots >= 2 && unit(rng) >= profile.reprice) {
+                    quantity -= profile.lot * (1 + rng() % (lots - 1));  // Keeps at least one lot
+                } else {
+                    // One or two ticks toward or away from the touch, never through the other side
+                    Price step = 1 + static_cast<Price>(rng() % 2);
+                    price += (rng() & 1) ? step : -step;
+                    price = order.side == Side::BUY ? std::min(price, touch(Side::SELL) - 1)
+                                                    : std::max(price, touch(Side::BUY) + 1);
+                }
+                emit(out, {OrderRequest::Kind::MODIFY, order.side, order.type, 0, target, price, quantity, {}});
+            }
+        }
+        return out;
+    }
+};
+
+template <typename Book>
+static void applyRequest(Book& book, const OrderRequest& request) {
+    switch (request.kind) {
+        case OrderRequest::Kind::NEW:
+            book.addOrderTicksWithId(request.order_id, request.side, request.type, request.price,
+                                     request.quantity, request.options);
+            break;
+        case OrderRequest::Kind::CANCEL:
+            book.cancelOrder(request.order_id);
+            break;
+        case OrderRequest::Kind::MODIFY:
+            book.modifyOrderTicks(request.order_id, request.price, request.quantity);
+            break;
+    }
+}
+
+/**
+ * @brief Apply the seed requests, then the measured ones, spinning until each
+ *        is due when `pace` > 0 (arrival times divided by `pace`)
+ * @return Milliseconds spent on the measured requests
+ */
+template <typename Book, typename PerMessage>
+static double run(Book& book, const Workload& flow, double pace, PerMessage&& per_message) {
+    for (size_t i = 0; i < flow.seed; ++i) applyRequest(book, flow.requests[i]);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = flow.seed; i < flow.requests.size(); ++i) {
+        if (pace > 0.0) {
+            auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(flow.arrivals[i] / pace));
+            while (std::chrono::steady_clock::now() < due) {}
+        }
+        per_message(book, flow.requests[i]);
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Index of dispersion of arrivals: variance over mean of the message count
+ *        per 100 us window, 1 for Poisson and larger the more the flow clusters
+ */
+static double dispersion(const Workload& flow) {
+    if (flow.requests.size() <= flow.seed + 1) return 0.0;
+    const uint64_t window = 100000;
+    uint64_t first = flow.arrivals[flow.seed];
+    std::vector<uint32_t> counts((flow.arrivals.back() - first) / window + 1, 0);
+    for (size_t i = flow.seed; i < flow.arrivals.size(); ++i) ++counts[(flow.arrivals[i] - first) / window];
+    double mean = 0.0, var = 0.0;
+    for (uint32_t c : counts) mean += c;
+    mean /= counts.size();
+    for (uint32_t c : counts) var += (c - mean) * (c - mean);
+    var /= counts.size();
+    return var / mean;
+}
+
+static void runProfile(const WorkloadProfile& profile, const Instrument& instrument, size_t n_messages,
+                       uint64_t seed, double pace, const std::string& csv_prefix) {
+    auto gen_start = std::chrono::steady_clock::now();
+    WorkloadGenerator generator(profile, instrument, seed);
+    Workload flow = generator.generate(n_messages);
+    double gen_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gen_start).count();
+
+    size_t measured = flow.requests.size() - flow.seed;
+    std::cout << "=== Profile: " << profile.name << " ===" << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << measured << " messages: adds "
+              << 100.0 * flow.counts[0] / measured << "%, cancels " << 100.0 * flow.counts[1] / measured
+              << "%, modifies " << 100.0 * flow.counts[2] / measured << "%, markets "
+              << 100.0 * flow.counts[3] / measured << "% after " << flow.seed << " seed orders ("
+              << std::setprecision(0) << gen_ms << " ms to generate)" << std::endl;
+    std::cout << std::setprecision(1) << "Arrivals: "
+              << (profile.branching > 0.0 ? "Hawkes" : "Poisson") << " at " << std::setprecision(0)
+              << profile.rate << " msgs/sec, dispersion index " << std::setprecision(1) << dispersion(flow)
+              << " (1 = Poisson)" << std::endl;
+
+    OrderBook book(instrument);
+    double ms = run(book, flow, pace, [](OrderBook& b, const OrderRequest& r) { applyRequest(b, r); });
+    std::cout << std::setprecision(0) << "Throughput: " << (measured * 1000.0 / ms) << " msgs/sec ("
+              << ms << " ms), " << book.getTotalTrades() << " trades, " << book.getRestingOrders()
+              << " resting at end" << std::endl;
+
+    // Per-message latency seen by the caller, and per-operation latency inside the book
+    TimedOrderBook timed(instrument);
+    LatencyHistogram all;
+    run(timed, flow, pace, [&](TimedOrderBook& b, const OrderRequest& r) {
+        uint64_t t0 = TscClock::ticks();
+        applyRequest(b, r);
+        all.record(TscClock::ticks() - t0);
+    });
+    double ns = TscClock::nsPerTick();
+    std::cout << "All messages (ns): p50 " << all.percentile(0.50) * ns << "  p99 " << all.percentile(0.99) * ns
+              << "  p99.9 " << all.percentile(0.999) * ns << "  max " << all.max() * ns << std::endl;
+    timed.latencyStats().print(std::cout);
+
+    if (!csv_prefix.empty()) {
+        std::string path = csv_prefix + profile.name + ".csv";
+        std::ofstream csv(path);
+        timed.latencyStats().dump(csv);
+        std::cout << "Histograms written to " << path << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  bench [--profile NAME] [--messages N] [--seed N] [--pace SPEED] [--csv PREFIX] [--list]\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<WorkloadProfile> profiles = standardProfiles();
+    std::string only, csv_prefix;
+    size_t n_messages = 2000000;
+    uint64_t seed = 42;
+    double pace = 0.0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--profile" && has_value) only = argv[++i];
+        else if (arg == "--messages" && has_value) n_messages = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && has_value) seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--pace" && has_value) pace = std::atof(argv[++i]);
+        else if (arg == "--csv" && has_value) csv_prefix = argv[++i];
+        else if (arg == "--list") {
+            for (const auto& p : profiles) std::cout << p.name << std::endl;
+            return 0;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    Instrument instrument{"BENCH", 0.01, 100.00, 2000};
+    bool ran = false;
+    for (const auto& profile : profiles) {
+        if (!only.empty() && profile.name != only) continue;
+        runProfile(profile, instrument, n_messages, seed, pace, csv_prefix);
+        ran = true;
+    }
+    if (!ran) {
+        std::cerr << "Unknown profile: " << only << " (see --list)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,467 +1,1282 @@
 /**
  * @file orderbook.cpp
- * @brief High-performance limit order book matching engine
- * 
- * Features:
- * - Price-time priority matching
- * - Market, Limit, and Cancel orders
- * - Efficient data structures (map for price levels, deque for orders)
- * - Real-time trade execution and order book state
- * 
- * Compile: g++ -std=c++17 -O3 -o orderbook orderbook.cpp
+ * @brief Limit order book simulator: demo scenarios and benchmarks for the engine in orderbook.hpp
+ *
+ * - Walk-through of order types, amends and the resulting book and trades
+ * - std::map reference book versus the tick ladder on the same order flow
+ * - Trade pipeline, binary protocol, journal, snapshot, L2 depth feed,
+ *   allocator, match-kernel, allocation-policy, ingress-queue, risk-check, self-trade, call-auction and
+ *   sharded-engine benchmarks
+ *
+ * Compile: g++ -std=c++17 -O3 -pthread -o orderbook orderbook.cpp
  * Run: ./orderbook
  */
 
+#include "orderbook.hpp"
+
 #include <iostream>
+#include <fstream>
 #include <map>
 #include <deque>
+#include <vector>
 #include <memory>
 #include <string>
 #include <iomanip>
 #include <chrono>
 #include <random>
+#include <functional>
+#include <thread>
+#include <atomic>
 
-// Order types
-enum class OrderType {
-    LIMIT,
-    MARKET
-};
+#include <sys/stat.h>
+#include <unistd.h>
 
-enum class Side {
-    BUY,
-    SELL
-};
-
-// Order structure
-struct Order {
-    uint64_t order_id;
-    Side side;
-    OrderType type;
-    double price;
-    uint64_t quantity;
-    std::chrono::system_clock::time_point timestamp;
-    
-    Order(uint64_t id, Side s, OrderType t, double p, uint64_t q)
-        : order_id(id), side(s), type(t), price(p), quantity(q),
-          timestamp(std::chrono::system_clock::now()) {}
-};
-
-// Trade execution record
-struct Trade {
-    uint64_t buy_order_id;
-    uint64_t sell_order_id;
-    double price;
-    uint64_t quantity;
-    std::chrono::system_clock::time_point timestamp;
-    
-    Trade(uint64_t bid, uint64_t sid, double p, uint64_t q)
-        : buy_order_id(bid), sell_order_id(sid), price(p), quantity(q),
-          timestamp(std::chrono::system_clock::now()) {}
-};
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 
 /**
- * @class OrderBook
- * @brief Limit order book with price-time priority matching
+ * @class MapOrderBook
+ * @brief Reference book keyed by double prices in std::map (the previous layout)
+ *
+ * Limit orders only; kept so the performance test can measure the ladder against it.
  */
-class OrderBook {
+class MapOrderBook {
 private:
-    // Price level: price -> queue of orders at that price (FIFO for time priority)
-    std::map<double, std::deque<std::shared_ptr<Order>>> bids;  // Buy orders (descending)
-    std::map<double, std::deque<std::shared_ptr<Order>>, std::greater<double>> asks;  // Sell orders (ascending)
-    
-    // Order lookup by ID
+    std::map<double, std::deque<std::shared_ptr<Order>>, std::greater<double>> bids;  // Highest first
+    std::map<double, std::deque<std::shared_ptr<Order>>> asks;  // Lowest first
     std::map<uint64_t, std::shared_ptr<Order>> order_map;
-    
-    // Trade history
-    std::vector<Trade> trade_history;
-    
+    SystemClock clock;
     uint64_t next_order_id = 1;
-    uint64_t total_orders_processed = 0;
     uint64_t total_trades = 0;
-    
-    /**
-     * @brief Match a market buy order against the ask side
-     */
-    void matchMarketBuy(std::shared_ptr<Order> order) {
-        while (!asks.empty() && order->quantity > 0) {
-            auto& [price, orders] = *asks.begin();
-            
+
+    // Trade record with the double price this book is keyed on
+    struct MapTrade {
+        uint64_t buy_order_id;
+        uint64_t sell_order_id;
+        double price;
+        uint64_t quantity;
+        std::chrono::system_clock::time_point timestamp;
+
+        MapTrade(uint64_t bid, uint64_t sid, double p, uint64_t q)
+            : buy_order_id(bid), sell_order_id(sid), price(p), quantity(q),
+              timestamp(std::chrono::system_clock::now()) {}
+    };
+    std::vector<MapTrade> trade_history;
+
+    template <typename Book>
+    void match(std::shared_ptr<Order> order, double price, Book& book, bool is_buy) {
+        while (!book.empty() && order->quantity > 0) {
+            auto& [best, orders] = *book.begin();
+            if (is_buy ? price < best : price > best) break;
+
             while (!orders.empty() && order->quantity > 0) {
-                auto& sell_order = orders.front();
-                
-                uint64_t trade_qty = std::min(order->quantity, sell_order->quantity);
-                
-                // Execute trade
-                trade_history.emplace_back(order->order_id, sell_order->order_id, price, trade_qty);
+                auto& resting = orders.front();
+                uint64_t trade_qty = std::min(order->quantity, resting->quantity);
+
+                uint64_t buy_id = is_buy ? order->order_id : resting->order_id;
+                uint64_t sell_id = is_buy ? resting->order_id : order->order_id;
+                trade_history.emplace_back(buy_id, sell_id, best, trade_qty);
                 total_trades++;
-                
+
                 order->quantity -= trade_qty;
-                sell_order->quantity -= trade_qty;
-                
-                // Remove filled order
-                if (sell_order->quantity == 0) {
-                    order_map.erase(sell_order->order_id);
+                resting->quantity -= trade_qty;
+                if (resting->quantity == 0) {
+                    order_map.erase(resting->order_id);
                     orders.pop_front();
                 }
             }
-            
-            // Remove empty price level
-            if (orders.empty()) {
-                asks.erase(asks.begin());
-            }
+
+            if (orders.empty()) book.erase(book.begin());
         }
     }
-    
-    /**
-     * @brief Match a market sell order against the bid side
-     */
-    void matchMarketSell(std::shared_ptr<Order> order) {
-        while (!bids.empty() && order->quantity > 0) {
-            auto& [price, orders] = *bids.begin();
-            
-            while (!orders.empty() && order->quantity > 0) {
-                auto& buy_order = orders.front();
-                
-                uint64_t trade_qty = std::min(order->quantity, buy_order->quantity);
-                
-                // Execute trade
-                trade_history.emplace_back(buy_order->order_id, order->order_id, price, trade_qty);
-                total_trades++;
-                
-                order->quantity -= trade_qty;
-                buy_order->quantity -= trade_qty;
-                
-                // Remove filled order
-                if (buy_order->quantity == 0) {
-                    order_map.erase(buy_order->order_id);
-                    orders.pop_front();
-                }
-            }
-            
-            // Remove empty price level
-            if (orders.empty()) {
-                bids.erase(bids.begin());
-            }
+
+public:
+    uint64_t addLimitOrder(Side side, double price, uint64_t quantity) {
+        auto order = std::make_shared<Order>(next_order_id++, side, OrderType::LIMIT, 0, quantity);
+        order->timestamp = clock.now();
+
+        if (side == Side::BUY) {
+            match(order, price, asks, true);
+            if (order->quantity > 0) bids[price].push_back(order);
+        } else {
+            match(order, price, bids, false);
+            if (order->quantity > 0) asks[price].push_back(order);
         }
+        if (order->quantity > 0) order_map[order->order_id] = order;
+
+        return order->order_id;
     }
-    
-    /**
-     * @brief Match a limit buy order
-     */
-    void matchLimitBuy(std::shared_ptr<Order> order) {
-        // Try to match against existing sell orders
-        while (!asks.empty() && order->quantity > 0) {
-            auto& [best_ask, orders] = *asks.begin();
-            
-            // Can only match if our bid price >= best ask price
-            if (order->price < best_ask) break;
-            
-            while (!orders.empty() && order->quantity > 0) {
-                auto& sell_order = orders.front();
-                
-                uint64_t trade_qty = std::min(order->quantity, sell_order->quantity);
-                
-                // Execute trade at the ask price (price-time priority)
-                trade_history.emplace_back(order->order_id, sell_order->order_id, best_ask, trade_qty);
-                total_trades++;
-                
-                order->quantity -= trade_qty;
-                sell_order->quantity -= trade_qty;
-                
-                if (sell_order->quantity == 0) {
-                    order_map.erase(sell_order->order_id);
-                    orders.pop_front();
-                }
-            }
-            
-            if (orders.empty()) {
-                asks.erase(asks.begin());
+
+    uint64_t getTotalTrades() const { return total_trades; }
+};
+
+/**
+ * @class InstructionCounter
+ * @brief Retired user-space instructions of this thread, via perf_event_open on Linux
+ *
+ * available() is false where hardware counters are not exposed (most VMs and
+ * containers); callers then report time only.
+ */
+class InstructionCounter {
+private:
+    int fd = -1;
+
+public:
+    InstructionCounter() {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~InstructionCounter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    InstructionCounter(const InstructionCounter&) = delete;
+    InstructionCounter& operator=(const InstructionCounter&) = delete;
+
+    bool available() const { return fd >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    uint64_t count() const {
+        uint64_t value = 0;
+#ifdef __linux__
+        if (fd >= 0 && ::read(fd, &value, sizeof(value)) != sizeof(value)) value = 0;
+#endif
+        return value;
+    }
+};
+
+/**
+ * @brief Sweep-heavy matching benchmark: lay `levels` x `orders_per_level` resting
+ *        orders on one side, then clear them with a single market order, alternating sides
+ *
+ * Only the sweeping market orders are timed and counted.
+ */
+template <typename Book>
+void benchmarkFills(Book& book, int rounds, int levels, int orders_per_level) {
+    InstructionCounter counter;
+    double sweep_ns = 0.0;
+    uint64_t fills_before = book.getTotalTrades();
+
+    for (int r = 0; r < rounds; ++r) {
+        Side resting = (r % 2 == 0) ? Side::SELL : Side::BUY;
+        double base = book.getInstrument().reference_price;
+        for (int l = 0; l < levels; ++l) {
+            double price = (resting == Side::SELL) ? base + 0.01 * l : base - 0.01 * l;
+            for (int i = 0; i < orders_per_level; ++i) {
+                book.addOrder(resting, OrderType::LIMIT, price, 10);
             }
         }
-        
-        // Add remaining quantity to bid book
-        if (order->quantity > 0) {
-            bids[order->price].push_back(order);
-            order_map[order->order_id] = order;
+
+        Side aggressor = (resting == Side::SELL) ? Side::BUY : Side::SELL;
+        uint64_t sweep_qty = 10ULL * levels * orders_per_level;
+        auto start = std::chrono::high_resolution_clock::now();
+        counter.start();
+        book.addOrder(aggressor, OrderType::MARKET, 0, sweep_qty);
+        counter.stop();
+        auto end = std::chrono::high_resolution_clock::now();
+        sweep_ns += std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    uint64_t fills = book.getTotalTrades() - fills_before;
+    std::cout << "Sweeps: " << rounds << " x " << levels << " levels x " << orders_per_level
+              << " orders, " << fills << " fills" << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << "Time per fill: " << (sweep_ns / fills) << " ns" << std::endl;
+    if (counter.available()) {
+        std::cout << "Instructions per fill: " << (static_cast<double>(counter.count()) / fills) << std::endl;
+    } else {
+        std::cout << "Instructions per fill: n/a (hardware counters not available)" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Allocation-policy cost on one deep level: `rounds` times, queue
+ *        `orders` asks of 1-100 shares at one price, then hit the level with
+ *        ten market buys of 5% of its size each
+ *
+ * Only the market buys are timed. FIFO fills the few orders at the front;
+ * pro-rata and hybrid walk the whole level for every aggressor.
+ */
+template <typename Book>
+void benchmarkAllocation(const char* label, const Instrument& instrument, int rounds, int orders) {
+    Book book(instrument);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint64_t> qty_dist(1, 100);
+    double hit_ns = 0.0;
+    uint64_t hits = 0;
+    uint64_t fills = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+        uint64_t level_qty = 0;
+        for (int i = 0; i < orders; ++i) {
+            uint64_t qty = qty_dist(rng);
+            book.addOrder(Side::SELL, OrderType::LIMIT, instrument.reference_price, qty);
+            level_qty += qty;
         }
+        uint64_t trades_before = book.getTotalTrades();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < 10; ++i) book.addOrder(Side::BUY, OrderType::MARKET, 0, level_qty / 20);
+        auto end = std::chrono::high_resolution_clock::now();
+        hit_ns += std::chrono::duration<double, std::nano>(end - start).count();
+        hits += 10;
+        fills += book.getTotalTrades() - trades_before;
+        book.addOrder(Side::BUY, OrderType::MARKET, 0, level_qty);  // Clear the level
     }
-    
-    /**
-     * @brief Match a limit sell order
-     */
-    void matchLimitSell(std::shared_ptr<Order> order) {
-        // Try to match against existing buy orders
-        while (!bids.empty() && order->quantity > 0) {
-            auto& [best_bid, orders] = *bids.begin();
-            
-            // Can only match if our ask price <= best bid price
-            if (order->price > best_bid) break;
-            
-            while (!orders.empty() && order->quantity > 0) {
-                auto& buy_order = orders.front();
-                
-                uint64_t trade_qty = std::min(order->quantity, buy_order->quantity);
-                
-                // Execute trade at the bid price
-                trade_history.emplace_back(buy_order->order_id, order->order_id, best_bid, trade_qty);
-                total_trades++;
-                
-                order->quantity -= trade_qty;
-                buy_order->quantity -= trade_qty;
-                
-                if (buy_order->quantity == 0) {
-                    order_map.erase(buy_order->order_id);
-                    orders.pop_front();
-                }
+
+    std::cout << label << std::fixed << std::setprecision(1) << (hit_ns / hits / 1000.0) << " us per aggressor, "
+              << (static_cast<double>(fills) / hits) << " fills each, " << (hit_ns / fills) << " ns per fill"
+              << std::endl;
+}
+
+/**
+ * @brief Gateway-to-matching handoff latency through a `Queue` (SpscQueue or MpscQueue)
+ *
+ * `producers` threads split `requests` between them and enqueue `batch` at a
+ * time, stamping each request with the TSC clock just before the push; one
+ * matching thread drains the queue into a book and records the delay at
+ * dequeue. Producers run flat out, so the tail reflects a saturated queue.
+ */
+template <template <typename> class Queue>
+void benchmarkHandoff(const char* label, const Instrument& instrument, const std::vector<OrderRequest>& requests,
+                      int producers, size_t batch) {
+    struct TimedRequest {
+        OrderRequest request;
+        uint64_t sent_at;
+    };
+
+    Queue<TimedRequest> queue(1 << 12);
+    OrderBook book(instrument);
+    std::vector<uint64_t> latencies;
+    latencies.reserve(requests.size());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::thread matcher([&] {
+        TscClock clock;
+        auto on_request = [&](const TimedRequest& timed) {
+            latencies.push_back(clock.now() - timed.sent_at);
+            const OrderRequest& r = timed.request;
+            if (r.kind == OrderRequest::Kind::CANCEL) {
+                book.cancelOrder(r.order_id);
+            } else {
+                book.addOrderTicksWithId(r.order_id, r.side, r.type, r.price, r.quantity, r.options);
             }
-            
-            if (orders.empty()) {
-                bids.erase(bids.begin());
+        };
+        while (latencies.size() < requests.size()) {
+            if (queue.drain(on_request, 64) == 0) std::this_thread::yield();
+        }
+    });
+
+    std::vector<std::thread> senders;
+    for (int p = 0; p < producers; ++p) {
+        senders.emplace_back([&, p] {
+            TscClock clock;
+            std::vector<TimedRequest> pending(batch);
+            size_t filled = 0;
+            for (size_t i = p; i < requests.size(); i += producers) {
+                pending[filled++].request = requests[i];
+                if (filled < batch && i + producers < requests.size()) continue;
+                uint64_t now = clock.now();
+                for (size_t k = 0; k < filled; ++k) pending[k].sent_at = now;
+                size_t sent = 0;
+                while (sent < filled) {
+                    size_t n = queue.pushBatch(pending.data() + sent, filled - sent);
+                    if (n == 0) std::this_thread::yield();
+                    sent += n;
+                }
+                filled = 0;
             }
+        });
+    }
+    for (auto& sender : senders) sender.join();
+    matcher.join();
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double q) { return latencies[static_cast<size_t>(q * (latencies.size() - 1))]; };
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << std::fixed << std::setprecision(0) << label << ": " << (requests.size() * 1000.0 / ms)
+              << " msgs/sec, latency ns p50 " << pct(0.50) << "  p99 " << pct(0.99)
+              << "  p99.9 " << pct(0.999) << "  max " << latencies.back() << std::endl;
+}
+
+/**
+ * @brief Engine throughput with 1, 2, 4, ... `max_shards` shards over the same
+ *        multi-symbol order flow, timed from first submit until every shard has drained
+ *
+ * Each shard gets its own producer thread and gateway, carrying the orders
+ * for that shard's symbols; producers and shards are pinned to separate
+ * CPUs where the machine has them. Fills come back through the engine's
+ * trade callback and are checked against the books' own trade counts.
+ */
+void benchmarkShards(const std::vector<Instrument>& instruments, int n_orders, uint32_t max_shards) {
+    struct EngineOrder { uint32_t symbol; Side side; Price price; uint64_t qty; };
+    struct alignas(64) SymbolFills { uint64_t trades = 0; uint64_t volume = 0; };  // Written by one shard
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint32_t> symbol_dist(0, static_cast<uint32_t>(instruments.size() - 1));
+    std::uniform_int_distribution<int> offset_dist(-100, 100);
+    std::uniform_int_distribution<uint64_t> qty_dist(10, 500);
+    std::uniform_int_distribution<int> side_dist(0, 1);
+
+    std::vector<EngineOrder> flow(n_orders);
+    for (auto& o : flow) {
+        o.symbol = symbol_dist(rng);
+        const Instrument& instrument = instruments[o.symbol];
+        o.side = (side_dist(rng) == 0) ? Side::BUY : Side::SELL;
+        o.price = instrument.toTicks(instrument.reference_price) + offset_dist(rng);
+        o.qty = qty_dist(rng);
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << instruments.size() << " symbols, " << n_orders << " orders, " << cores << " hardware threads"
+              << std::endl;
+    double base_rate = 0.0;
+    for (uint32_t shards = 1; shards <= max_shards; shards *= 2) {
+        EngineConfig config = EngineConfig::roundRobin(instruments.size(), shards);
+        for (uint32_t s = 0; s < shards; ++s) config.cpus.push_back(static_cast<int>(s % cores));
+        config.gateways = shards;
+        config.orders_per_book = 1 << 13;
+        std::vector<SymbolFills> fills(instruments.size());
+        config.on_trade = [&fills](uint32_t symbol, const Trade& trade) {
+            ++fills[symbol].trades;
+            fills[symbol].volume += trade.quantity;
+        };
+
+        // The producer for shard s carries the orders for that shard's symbols
+        std::vector<std::vector<EngineOrder>> lanes(shards);
+        for (const auto& o : flow) lanes[config.shard_of[o.symbol]].push_back(o);
+
+        MatchingEngine engine(instruments, config);
+        std::atomic<bool> go{false};
+        std::vector<std::thread> producers;
+        for (uint32_t s = 0; s < shards; ++s) {
+            producers.emplace_back([&engine, &go, &lane = lanes[s], s] {
+                MatchingEngine::Gateway& gateway = engine.gateway(s);
+                while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                for (const auto& o : lane) gateway.submitNew(o.symbol, o.side, OrderType::LIMIT, o.price, o.qty);
+            });
+            pinThread(producers.back(), (shards + s) % cores);
         }
-        
-        // Add remaining quantity to ask book
-        if (order->quantity > 0) {
-            asks[order->price].push_back(order);
-            order_map[order->order_id] = order;
+        auto start = std::chrono::high_resolution_clock::now();
+        go.store(true, std::memory_order_release);
+        for (auto& producer : producers) producer.join();
+        engine.stop();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        uint64_t book_trades = 0, callback_trades = 0, volume = 0;
+        for (uint32_t i = 0; i < engine.symbolCount(); ++i) {
+            book_trades += engine.book(i).getTotalTrades();
+            callback_trades += fills[i].trades;
+            volume += fills[i].volume;
         }
+        uint64_t shard_trades = 0;
+        for (uint32_t s = 0; s < shards; ++s) shard_trades += engine.trades(s);
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        double rate = n_orders * 1000.0 / ms;
+        if (shards == 1) base_rate = rate;
+        std::cout << std::fixed << std::setprecision(0) << "Shards: " << shards << "  " << ms << " ms  "
+                  << rate << " orders/sec  (" << std::setprecision(2) << (rate / base_rate) << "x, "
+                  << callback_trades << " trades, " << volume << " shares"
+                  << (callback_trades == book_trades && shard_trades == book_trades ? ")" : "; MISMATCH with the books)")
+                  << std::endl;
+        std::cout << "  processed / trades by shard:";
+        for (uint32_t s = 0; s < shards; ++s) std::cout << " " << engine.processed(s) << "/" << engine.trades(s);
+        std::cout << std::endl;
     }
-    
-public:
-    /**
-     * @brief Add a new order to the book
-     * @return Order ID
-     */
-    uint64_t addOrder(Side side, OrderType type, double price, uint64_t quantity) {
-        auto order = std::make_shared<Order>(next_order_id++, side, type, price, quantity);
-        total_orders_processed++;
-        
-        if (type == OrderType::MARKET) {
-            if (side == Side::BUY) {
-                matchMarketBuy(order);
-            } else {
-                matchMarketSell(order);
-            }
-        } else {  // LIMIT
-            if (side == Side::BUY) {
-                matchLimitBuy(order);
-            } else {
-                matchLimitSell(order);
+
+    // One request that sweeps 5000 resting orders: every fill must reach the handler
+    uint64_t swept = 0;
+    EngineConfig config = EngineConfig::roundRobin(1, 1);
+    config.on_trade = [&swept](uint32_t, const Trade&) { ++swept; };
+    MatchingEngine sweep_engine({instruments[0]}, config);
+    Price ask = instruments[0].toTicks(instruments[0].reference_price) + 1;
+    for (int i = 0; i < 5000; ++i) sweep_engine.gateway(0).submitNew(0, Side::SELL, OrderType::LIMIT, ask, 1);
+    sweep_engine.gateway(0).submitNew(0, Side::BUY, OrderType::MARKET, 0, 5000);
+    sweep_engine.stop();
+    std::cout << "One market order sweeping 5000 orders: " << swept << " fills delivered ("
+              << (swept == 5000 && sweep_engine.trades(0) == 5000 ? "all" : "MISMATCH") << ")" << std::endl
+              << std::endl;
+}
+
+/**
+ * @brief Mean nanoseconds per allocate+release pair with `live` records outstanding,
+ *        released oldest-first the way resting orders turn over
+ */
+template <typename Alloc, typename Release>
+double allocatorNsPerOrder(int n, size_t live, Alloc alloc, Release release) {
+    std::vector<decltype(alloc())> ring;
+    ring.reserve(live);
+    for (size_t i = 0; i < live; ++i) ring.push_back(alloc());
+
+    size_t head = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < n; ++i) {
+        release(ring[head]);
+        ring[head] = alloc();
+        head = (head + 1 == live) ? 0 : head + 1;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (auto& r : ring) release(r);
+    return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+/**
+ * @brief Per-message latency of BookSession with and without a write-ahead journal,
+ *        then the time to rebuild the book from that journal, in full and from a
+ *        snapshot taken 90% of the way through plus the journal tail
+ *
+ * Segments and the snapshot go to `dir` and are removed afterwards.
+ */
+void benchmarkJournal(const Instrument& instrument, const MsgWriter& inbound, const std::string& dir) {
+    ::mkdir(dir.c_str(), 0755);
+    TscClock clock;
+    OrderBook plain_book(instrument), journaled_book(instrument);
+    uint64_t journaled_commits = 0, journaled_stalls = 0;
+
+    for (int journaled = 0; journaled < 2; ++journaled) {
+        OrderBook& book = journaled ? journaled_book : plain_book;
+        std::unique_ptr<Journal> journal;
+        if (journaled) journal = std::make_unique<Journal>(JournalConfig{dir, 64 << 20, 100});
+        BookSession<OrderBook> session(book, 0, nullptr, journal.get());
+
+        struct TimedSession : MsgHandler {
+            BookSession<OrderBook>& session;
+            TscClock& clock;
+            std::vector<uint64_t> latencies;
+            std::function<void()> at_snapshot;
+            size_t snapshot_at = 0;
+            TimedSession(BookSession<OrderBook>& s, TscClock& c) : session(s), clock(c) {}
+            void onNewOrder(const NewOrderMsg& msg) {
+                uint64_t t0 = clock.now();
+                session.onNewOrder(msg);
+                latencies.push_back(clock.now() - t0);
+                if (latencies.size() == snapshot_at && at_snapshot) at_snapshot();
             }
+        } timed(session, clock);
+        timed.latencies.reserve(inbound.size() / sizeof(NewOrderMsg));
+        if (journal) {
+            timed.snapshot_at = inbound.size() / sizeof(NewOrderMsg) * 9 / 10;
+            timed.at_snapshot = [&] { book.saveSnapshot(dir + "/book.snap", journal->lastSequence()); };
         }
-        
-        return order->order_id;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        decodeMessages(inbound.data(), inbound.size(), timed);
+        if (journal) journal->waitDurable(journal->lastSequence());
+        auto end = std::chrono::high_resolution_clock::now();
+        if (journal) {
+            journaled_commits = journal->groupCommits();
+            journaled_stalls = journal->rolloverStalls();
+        }
+
+        std::vector<uint64_t>& lat = timed.latencies;
+        std::sort(lat.begin(), lat.end());
+        auto pct = [&](double q) { return lat[static_cast<size_t>(q * (lat.size() - 1))]; };
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cout << std::fixed << std::setprecision(0) << (journaled ? "Journal on:  " : "Journal off: ")
+                  << (lat.size() * 1000.0 / ms) << " msgs/sec, latency ns p50 " << pct(0.50) << "  p99 "
+                  << pct(0.99) << "  p99.9 " << pct(0.999) << "  max " << lat.back() << std::endl;
     }
-    
-    /**
-     * @brief Cancel an existing order
-     */
-    bool cancelOrder(uint64_t order_id) {
-        auto it = order_map.find(order_id);
-        if (it == order_map.end()) return false;
-        
-        auto order = it->second;
-        
-        // Remove from price level
-        if (order->side == Side::BUY) {
-            auto& orders = bids[order->price];
-            orders.erase(std::remove(orders.begin(), orders.end(), order), orders.end());
-            if (orders.empty()) bids.erase(order->price);
+    std::cout << "Group commits: " << journaled_commits << ", rollover stalls: " << journaled_stalls << std::endl;
+
+    OrderBook recovered(instrument);
+    BookSession<OrderBook> recovery_session(recovered, 0);
+    auto start = std::chrono::high_resolution_clock::now();
+    JournalRecovery recovery = Journal::replay(dir, recovery_session);
+    auto end = std::chrono::high_resolution_clock::now();
+    bool identical = recovered.getRestingOrders() == journaled_book.getRestingOrders() &&
+                     recovered.getTotalTrades() == journaled_book.getTotalTrades() &&
+                     recovered.getBestBid() == journaled_book.getBestBid() &&
+                     recovered.getBestAsk() == journaled_book.getBestAsk();
+    std::cout << "Recovered " << recovery.records << " records in "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms: "
+              << recovered.getRestingOrders() << " resting orders, " << recovered.getTotalTrades() << " trades ("
+              << (identical ? "matches" : "DIFFERS FROM") << " the live book)" << std::endl;
+
+    OrderBook restarted(instrument);
+    BookSession<OrderBook> tail_session(restarted, 0);
+    uint64_t snapshot_sequence = 0;
+    start = std::chrono::high_resolution_clock::now();
+    bool loaded = restarted.loadSnapshot(dir + "/book.snap", &snapshot_sequence);
+    auto loaded_at = std::chrono::high_resolution_clock::now();
+    JournalRecovery tail = Journal::replay(dir, tail_session, snapshot_sequence);
+    end = std::chrono::high_resolution_clock::now();
+    identical = loaded && restarted.getRestingOrders() == journaled_book.getRestingOrders() &&
+                restarted.getTotalTrades() == journaled_book.getTotalTrades() &&
+                restarted.getBestBid() == journaled_book.getBestBid() &&
+                restarted.getBestAsk() == journaled_book.getBestAsk();
+    std::cout << "Snapshot at record " << snapshot_sequence << " loaded in "
+              << std::chrono::duration<double, std::milli>(loaded_at - start).count() << " ms, "
+              << tail.replayed << "-record tail replayed in "
+              << std::chrono::duration<double, std::milli>(end - loaded_at).count() << " ms ("
+              << (identical ? "matches" : "DIFFERS FROM") << " the live book)" << std::endl;
+
+    // A journal that cannot take a message: nothing unlogged may reach the book
+    Journal broken(JournalConfig{dir + "/missing/journal", 1 << 20, 100});
+    OrderBook unlogged_book(instrument);
+    MsgWriter unlogged_acks;
+    BookSession<OrderBook> unlogged(unlogged_book, 0, &unlogged_acks, &broken);
+    MsgWriter unlogged_flow;
+    Price mid = instrument.toTicks(instrument.reference_price);
+    unlogged_flow.newOrder(0, 0, Side::BUY, OrderType::LIMIT, mid, 100);
+    unlogged_flow.newOrder(0, 0, Side::SELL, OrderType::LIMIT, mid + 1, 100);
+    decodeMessages(unlogged_flow.data(), unlogged_flow.size(), unlogged);
+    struct RejectCounter : MsgHandler {
+        uint64_t rejected = 0;
+        void onOrderAck(const OrderAckMsg& msg) { rejected += msg.status == static_cast<uint8_t>(AckStatus::REJECTED); }
+    } rejects;
+    decodeMessages(unlogged_acks.data(), unlogged_acks.size(), rejects);
+    bool unlogged_ok = unlogged.journalFailed() && rejects.rejected == 2 && unlogged_book.getRestingOrders() == 0;
+    std::cout << "Journal append failure: " << rejects.rejected << " of 2 orders rejected unapplied ("
+              << (unlogged_ok ? "book untouched" : "FAILED") << ")" << std::endl << std::endl;
+
+    ::unlink((dir + "/book.snap").c_str());
+    Journal::removeSegments(dir);
+    ::rmdir(dir.c_str());
+}
+
+/**
+ * @brief Depth sink keeping the levels a downstream L2 consumer would show
+ */
+struct DepthMirror {
+    std::map<std::pair<Side, Price>, uint64_t> levels;  // Displayed quantity by side and price
+
+    explicit DepthMirror(const Instrument&) {}
+
+    void onLevelUpdate(Side side, Price price, uint64_t quantity, uint32_t order_count) {
+        if (order_count == 0) {
+            levels.erase({side, price});
         } else {
-            auto& orders = asks[order->price];
-            orders.erase(std::remove(orders.begin(), orders.end(), order), orders.end());
-            if (orders.empty()) asks.erase(order->price);
+            levels[{side, price}] = quantity;
         }
-        
-        order_map.erase(it);
-        return true;
-    }
-    
-    /**
-     * @brief Get best bid price
-     */
-    double getBestBid() const {
-        return bids.empty() ? 0.0 : bids.begin()->first;
-    }
-    
-    /**
-     * @brief Get best ask price
-     */
-    double getBestAsk() const {
-        return asks.empty() ? 0.0 : asks.begin()->first;
-    }
-    
-    /**
-     * @brief Get mid price
-     */
-    double getMidPrice() const {
-        if (bids.empty() || asks.empty()) return 0.0;
-        return (getBestBid() + getBestAsk()) / 2.0;
-    }
-    
-    /**
-     * @brief Get spread
-     */
-    double getSpread() const {
-        if (bids.empty() || asks.empty()) return 0.0;
-        return getBestAsk() - getBestBid();
-    }
-    
-    /**
-     * @brief Print order book state
-     */
-    void printOrderBook(int depth = 5) const {
-        std::cout << "\n=== Order Book ===" << std::endl;
-        std::cout << std::fixed << std::setprecision(2);
-        
-        // Ask side (sell orders)
-        std::cout << "\n--- ASKS (Sell) ---" << std::endl;
-        std::cout << std::setw(12) << "Price" << std::setw(15) << "Quantity" << std::setw(15) << "Orders" << std::endl;
-        std::cout << std::string(42, '-') << std::endl;
-        
-        int count = 0;
-        for (auto it = asks.rbegin(); it != asks.rend() && count < depth; ++it, ++count) {
-            uint64_t total_qty = 0;
-            for (const auto& order : it->second) {
-                total_qty += order->quantity;
-            }
-            std::cout << std::setw(12) << it->first 
-                      << std::setw(15) << total_qty 
-                      << std::setw(15) << it->second.size() << std::endl;
-        }
-        
-        // Spread
-        std::cout << "\n" << std::string(42, '=') << std::endl;
-        std::cout << "Spread: $" << getSpread() << " | Mid: $" << getMidPrice() << std::endl;
-        std::cout << std::string(42, '=') << "\n" << std::endl;
-        
-        // Bid side (buy orders)
-        std::cout << "--- BIDS (Buy) ---" << std::endl;
-        std::cout << std::setw(12) << "Price" << std::setw(15) << "Quantity" << std::setw(15) << "Orders" << std::endl;
-        std::cout << std::string(42, '-') << std::endl;
-        
-        count = 0;
-        for (const auto& [price, orders] : bids) {
-            if (count >= depth) break;
-            uint64_t total_qty = 0;
-            for (const auto& order : orders) {
-                total_qty += order->quantity;
-            }
-            std::cout << std::setw(12) << price 
-                      << std::setw(15) << total_qty 
-                      << std::setw(15) << orders.size() << std::endl;
-            count++;
+    }
+};
+
+/**
+ * @brief Save and load times for a book holding `n_resting` orders, quiescent and forked
+ */
+void benchmarkSnapshot(const Instrument& instrument, size_t n_resting, const std::string& path) {
+    OrderBook book(instrument, n_resting);
+    Price mid = instrument.toTicks(instrument.reference_price);
+    for (size_t i = 0; i < n_resting; ++i) {
+        Price offset = 1 + static_cast<Price>(i / 2 % static_cast<size_t>(instrument.ladder_ticks));
+        Side side = (i % 2 == 0) ? Side::BUY : Side::SELL;
+        book.addOrderTicks(side, OrderType::LIMIT, side == Side::BUY ? mid - offset : mid + offset, 100);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    bool saved = book.saveSnapshot(path);
+    auto end = std::chrono::high_resolution_clock::now();
+    double save_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    struct stat st {};
+    ::stat(path.c_str(), &st);
+
+    OrderBook loaded(instrument, n_resting);
+    start = std::chrono::high_resolution_clock::now();
+    bool ok = saved && loaded.loadSnapshot(path);
+    end = std::chrono::high_resolution_clock::now();
+    double load_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    ok = ok && loaded.getRestingOrders() == book.getRestingOrders() && loaded.getBestBid() == book.getBestBid() &&
+         loaded.getBestAsk() == book.getBestAsk() && loaded.depthWithin(Side::BUY, 10) == book.depthWithin(Side::BUY, 10);
+
+    // Copy-on-write: the parent only pays for fork() before it can keep matching
+    start = std::chrono::high_resolution_clock::now();
+    int pid = book.forkSnapshot(path);
+    end = std::chrono::high_resolution_clock::now();
+    double fork_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    bool forked = OrderBook::waitSnapshot(pid);
+
+    std::cout << std::fixed << std::setprecision(1) << book.getRestingOrders() << " resting orders, "
+              << (st.st_size >> 20) << " MiB image: save " << save_ms << " ms, load " << load_ms << " ms ("
+              << (ok ? "identical" : "MISMATCH") << "); forked save blocks matching for " << fork_ms << " ms ("
+              << (forked ? "written" : "FAILED") << ")" << std::endl;
+
+    // Loading over a live book in an auction must leave nothing of it behind:
+    // compare against the same image loaded into a fresh book
+    using MirroredBook = BasicOrderBook<TscClock, TradeRing, DenseIdHash, DepthMirror, NullLatency, RiskTable>;
+    MirroredBook fresh(instrument, n_resting);
+    MirroredBook live(instrument, n_resting);
+    OrderOptions account_three;
+    account_three.account = 3;
+    live.addOrderTicks(Side::BUY, OrderType::LIMIT, mid, 100, account_three);
+    live.startAuction();
+    live.addOrderTicks(Side::SELL, OrderType::LIMIT, mid, 40, account_three);
+    bool reset_ok = fresh.loadSnapshot(path) && live.loadSnapshot(path);
+    reset_ok = reset_ok && live.tradingPhase() == TradingPhase::CONTINUOUS &&
+               live.indicativeAuction().volume == 0 && live.depthSink().levels == fresh.depthSink().levels &&
+               live.risk().account(3).open_orders == 0 && live.risk().account(3).open_buy_quantity == 0 &&
+               live.risk().account(0).open_orders == fresh.risk().account(0).open_orders;
+    std::cout << "Load over a live book in an auction: depth, risk exposure and auction state "
+              << (reset_ok ? "reset" : "FAILED") << std::endl << std::endl;
+    ::unlink(path.c_str());
+}
+
+/**
+ * @brief Cost of pre-trade risk checks: the same requests through OrderBook and
+ *        RiskOrderBook (limits never hit), a rejected order against a resting
+ *        insert, and rejection counts by reason under tight limits
+ *
+ * Requests are spread round-robin over `accounts` accounts.
+ */
+void benchmarkRisk(const Instrument& instrument, std::vector<OrderRequest> requests, uint32_t accounts) {
+    for (size_t i = 0; i < requests.size(); ++i) requests[i].options.account = static_cast<uint32_t>(i % accounts);
+    auto time_ns = [&](auto& book, size_t n) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < n; ++i) {
+            const OrderRequest& r = requests[i];
+            book.addOrderTicks(r.side, r.type, r.price, r.quantity, r.options);
         }
-        std::cout << std::endl;
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / n;
+    };
+
+    OrderBook plain(instrument);
+    RiskOrderBook checked(instrument);
+    double plain_ns = time_ns(plain, requests.size());
+    double checked_ns = time_ns(checked, requests.size());
+
+    // Resting inserts (bids below the market into an empty book) against orders
+    // from an account whose size limit rejects everything
+    std::vector<OrderRequest> passive(requests.begin(), requests.begin() + std::min<size_t>(requests.size(), 200000));
+    Price low = instrument.toTicks(instrument.reference_price) - instrument.ladder_ticks;
+    for (size_t i = 0; i < passive.size(); ++i) {
+        passive[i].side = Side::BUY;
+        passive[i].price = low + static_cast<Price>(i % 500);
+        passive[i].options.account = 0;
     }
-    
-    /**
-     * @brief Print recent trades
-     */
-    void printRecentTrades(int n = 10) const {
-        std::cout << "=== Recent Trades ===" << std::endl;
-        std::cout << std::setw(12) << "Buy ID" 
-                  << std::setw(12) << "Sell ID" 
-                  << std::setw(12) << "Price" 
-                  << std::setw(12) << "Quantity" << std::endl;
-        std::cout << std::string(48, '-') << std::endl;
-        
-        int start = std::max(0, (int)trade_history.size() - n);
-        for (int i = start; i < trade_history.size(); ++i) {
-            const auto& trade = trade_history[i];
-            std::cout << std::setw(12) << trade.buy_order_id
-                      << std::setw(12) << trade.sell_order_id
-                      << std::setw(12) << std::fixed << std::setprecision(2) << trade.price
-                      << std::setw(12) << trade.quantity << std::endl;
+    std::swap(requests, passive);
+    RiskOrderBook resting_book(instrument);
+    double rest_ns = time_ns(resting_book, requests.size());
+    RiskOrderBook rejecting_book(instrument);
+    RiskLimits none;
+    none.max_order_quantity = 0;
+    rejecting_book.risk().setLimits(0, none);
+    double reject_ns = time_ns(rejecting_book, requests.size());
+    std::swap(requests, passive);
+
+    // Tight limits: rejections by reason
+    RiskOrderBook tight(instrument);
+    RiskLimits limits;
+    limits.max_order_quantity = 450;
+    limits.max_order_notional = 400 * instrument.toTicks(instrument.reference_price);
+    limits.max_open_orders = 150;
+    limits.max_position = 20000;
+    limits.credit_limit = 1000000 * instrument.toTicks(instrument.reference_price) / 100;
+    for (uint32_t a = 0; a < accounts; ++a) tight.risk().setLimits(a, limits);
+    tight.risk().setPriceBand(90);
+    uint64_t reasons[8] = {};
+    for (const auto& r : requests) {
+        if (!tight.addOrderTicks(r.side, r.type, r.price, r.quantity, r.options)) {
+            ++reasons[static_cast<size_t>(tight.lastRiskReject())];
         }
-        std::cout << std::endl;
     }
-    
-    /**
-     * @brief Print statistics
-     */
-    void printStats() const {
-        std::cout << "=== Order Book Statistics ===" << std::endl;
-        std::cout << "Total orders processed: " << total_orders_processed << std::endl;
-        std::cout << "Total trades executed: " << total_trades << std::endl;
-        std::cout << "Active bid orders: " << order_map.size() << std::endl;
-        std::cout << "Best bid: $" << std::fixed << std::setprecision(2) << getBestBid() << std::endl;
-        std::cout << "Best ask: $" << getBestAsk() << std::endl;
-        std::cout << "Spread: $" << getSpread() << std::endl;
-        std::cout << std::endl;
+
+    std::cout << std::fixed << std::setprecision(1) << "addOrder: " << plain_ns << " ns unchecked, " << checked_ns
+              << " ns with risk checks (+" << (checked_ns - plain_ns) << " ns, " << accounts << " accounts)"
+              << std::endl;
+    std::cout << "Resting insert: " << rest_ns << " ns; risk rejection: " << reject_ns << " ns" << std::endl;
+    std::cout << "Tight limits rejected: size " << reasons[static_cast<size_t>(RiskReject::ORDER_SIZE)]
+              << ", notional " << reasons[static_cast<size_t>(RiskReject::ORDER_NOTIONAL)]
+              << ", open orders " << reasons[static_cast<size_t>(RiskReject::OPEN_ORDERS)]
+              << ", position " << reasons[static_cast<size_t>(RiskReject::POSITION)]
+              << ", credit " << reasons[static_cast<size_t>(RiskReject::CREDIT)]
+              << ", price band " << reasons[static_cast<size_t>(RiskReject::PRICE_BAND)]
+              << " of " << requests.size() << " orders" << std::endl;
+
+    // One open order allowed: a second limit order is refused, while IOC and
+    // market orders, which never rest, still go through
+    RiskOrderBook capped(instrument);
+    RiskLimits one_order;
+    one_order.max_open_orders = 1;
+    capped.risk().setLimits(1, one_order);
+    OrderOptions account_one;
+    account_one.account = 1;
+    Price mid = instrument.toTicks(instrument.reference_price);
+    bool capped_ok = capped.addOrderTicks(Side::BUY, OrderType::LIMIT, mid - 10, 100, account_one) != 0;
+    capped_ok &= !capped.addOrderTicks(Side::BUY, OrderType::LIMIT, mid - 11, 100, account_one) &&
+                 capped.lastRiskReject() == RiskReject::OPEN_ORDERS;
+    capped.addOrderTicks(Side::SELL, OrderType::LIMIT, mid + 10, 300);
+    capped_ok &= capped.addOrderTicks(Side::BUY, OrderType::IOC, mid + 10, 100, account_one) != 0;
+    capped_ok &= capped.addOrderTicks(Side::BUY, OrderType::MARKET, 0, 100, account_one) != 0;
+    capped_ok &= capped.risk().account(1).position == 200 && capped.risk().account(1).open_orders == 1;
+
+    // Wire orders through the engine keep their account: account 7's size
+    // limit refuses the large order and the small one rests under account 7
+    BasicMatchingEngine<RiskOrderBook> engine({instrument}, EngineConfig::roundRobin(1, 1));
+    RiskLimits small;
+    small.max_order_quantity = 100;
+    engine.book(0).risk().setLimits(7, small);
+    OrderOptions account_seven;
+    account_seven.account = 7;
+    MsgWriter wire;
+    wire.newOrder(0, 0, Side::BUY, OrderType::LIMIT, mid - 10, 500, account_seven);
+    wire.newOrder(0, 0, Side::BUY, OrderType::LIMIT, mid - 10, 50, account_seven);
+    engine.gateway(0).submitMessages(wire.data(), wire.size());
+    engine.stop();
+    const RiskAccount& seven = engine.book(0).risk().account(7);
+    bool engine_ok = seven.open_orders == 1 && seven.open_buy_quantity == 50;
+    std::cout << "Open-order cap with IOC and market orders: " << (capped_ok ? "OK" : "FAILED")
+              << "; account limit through the engine: " << (engine_ok ? "OK" : "FAILED") << std::endl << std::endl;
+}
+
+/**
+ * @brief Trade sink that counts wash trades: fills whose buy and sell orders
+ *        belong to the same non-zero account
+ */
+struct WashCounter {
+    const std::vector<uint32_t>* owner;  // Account by order ID
+    uint64_t trades = 0;
+    uint64_t washes = 0;
+
+    explicit WashCounter(const std::vector<uint32_t>* owner_) : owner(owner_) {}
+
+    void onTrade(const Trade& trade) {
+        ++trades;
+        uint32_t buyer = (*owner)[trade.buy_order_id];
+        if (buyer != 0 && buyer == (*owner)[trade.sell_order_id]) ++washes;
     }
 };
 
-int main() {
+/**
+ * @brief Self-trade prevention under each policy: the same requests, spread
+ *        round-robin over `accounts` accounts, with wash trades and prevented
+ *        matches counted per mode
+ */
+void benchmarkSelfTrade(const Instrument& instrument, std::vector<OrderRequest> requests, uint32_t accounts) {
+    using WashBook = BasicOrderBook<TscClock, WashCounter>;
+    for (size_t i = 0; i < requests.size(); ++i) requests[i].options.account = 1 + static_cast<uint32_t>(i % accounts);
+
+    const std::pair<const char*, SelfTradePrevention> modes[] = {
+        {"none            ", SelfTradePrevention::NONE},
+        {"cancel resting  ", SelfTradePrevention::CANCEL_RESTING},
+        {"cancel aggressor", SelfTradePrevention::CANCEL_AGGRESSOR},
+        {"cancel both     ", SelfTradePrevention::CANCEL_BOTH},
+        {"decrement       ", SelfTradePrevention::DECREMENT},
+    };
+    std::cout << requests.size() << " orders over " << accounts << " accounts" << std::endl;
+    for (const auto& [label, mode] : modes) {
+        // The book assigns IDs in sequence to accepted orders, so the owner of
+        // the next ID is known before the order reaches the match loop
+        std::vector<uint32_t> owner(requests.size() + 1, 0);
+        uint64_t next_id = 1;
+        WashBook book(instrument, 1 << 20, &owner);
+        book.setSelfTradePrevention(mode);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& r : requests) {
+            owner[next_id] = r.options.account;
+            if (book.addOrderTicks(r.side, r.type, r.price, r.quantity, r.options)) ++next_id;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / requests.size();
+        std::cout << label << ": " << book.tradeSink().trades << " trades, " << book.tradeSink().washes
+                  << " wash, " << book.getSelfTradesPrevented() << " prevented, " << std::fixed
+                  << std::setprecision(1) << ns << " ns/order" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Call-auction cost: queueing `requests` in an auction with and without
+ *        an indicative quote after every message, then one uncross of the lot
+ */
+void benchmarkAuction(const Instrument& instrument, const std::vector<OrderRequest>& requests) {
+    uint64_t quoted_volume = 0;  // Sum of the per-message indicative volumes
+    auto queue_ns = [&](auto& book, bool quote_each) {
+        book.startAuction();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto& r : requests) {
+            book.addOrderTicks(r.side, r.type, r.price, r.quantity, r.options);
+            if (quote_each) quoted_volume += book.indicativeAuction().volume;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / requests.size();
+    };
+
+    OrderBook plain(instrument);
+    double add_ns = queue_ns(plain, false);
+    OrderBook quoted(instrument);
+    double quoted_ns = queue_ns(quoted, true);
+
+    AuctionQuote indicative = quoted.indicativeAuction();
+    uint64_t trades_before = quoted.getTotalTrades();
+    auto start = std::chrono::high_resolution_clock::now();
+    AuctionQuote result = quoted.uncross();
+    auto end = std::chrono::high_resolution_clock::now();
+    double uncross_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    std::cout << std::fixed << std::setprecision(1) << requests.size() << " orders queued: " << add_ns
+              << " ns/order, " << quoted_ns << " ns/order with an indicative quote per message (+"
+              << (quoted_ns - add_ns) << " ns, mean indicative volume "
+              << (quoted_volume / requests.size()) << ")" << std::endl;
+    std::cout << "Uncross: " << result.volume << " shares @ $" << std::setprecision(2)
+              << instrument.toPrice(result.price) << " (imbalance " << result.imbalance << ") in "
+              << (quoted.getTotalTrades() - trades_before) << " fills, " << std::setprecision(1) << uncross_ms
+              << " ms" << (indicative.volume == result.volume && indicative.price == result.price
+                           ? "; matches the last indicative quote" : "; DIFFERS from the last indicative quote")
+              << std::endl;
+
+    // Reductions during the auction: halving every fourth queued order must
+    // leave the same quote and uncross as queueing it at half size
+    size_t n = std::min<size_t>(requests.size(), 100000);
+    OrderBook reduced(instrument);
+    OrderBook sized(instrument);
+    reduced.startAuction();
+    sized.startAuction();
+    bool reduces_ok = true;
+    for (size_t i = 0; i < n; ++i) {
+        const OrderRequest& r = requests[i];
+        uint64_t cut = i % 4 == 0 ? r.quantity / 2 : 0;
+        uint64_t id = reduced.addOrderTicks(r.side, r.type, r.price, r.quantity, r.options);
+        if (cut) reduces_ok &= reduced.reduceOrder(id, cut);
+        sized.addOrderTicks(r.side, r.type, r.price, r.quantity - cut, r.options);
+    }
+    AuctionQuote reduced_quote = reduced.indicativeAuction();
+    AuctionQuote sized_quote = sized.indicativeAuction();
+    reduces_ok &= reduced_quote.price == sized_quote.price && reduced_quote.volume == sized_quote.volume &&
+                  reduced_quote.imbalance == sized_quote.imbalance;
+    AuctionQuote reduced_result = reduced.uncross();
+    AuctionQuote sized_result = sized.uncross();
+    reduces_ok &= reduced_result.volume == reduced_quote.volume && reduced_result.price == sized_result.price &&
+                  reduced_result.volume == sized_result.volume &&
+                  reduced.getTotalTrades() == sized.getTotalTrades();
+    std::cout << "Reduce during the auction: " << reduced_result.volume << " shares uncrossed; "
+              << (reduces_ok ? "matches" : "DIFFERS FROM") << " the book queued at the reduced sizes"
+              << std::endl << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string latency_csv_path;  // --latency-csv PATH: also dump the timed book's histograms there
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--latency-csv" && i + 1 < argc) {
+            latency_csv_path = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--latency-csv PATH]" << std::endl;
+            return 1;
+        }
+    }
+
     std::cout << "=== Limit Order Book Simulator ===" << std::endl << std::endl;
-    
-    OrderBook book;
-    
+
+    // Instrument reference data: tick size and a +/-10% price ladder
+    TickSizeTable tick_table;
+    tick_table.add({"DEMO", 0.01, 100.00, 1000});
+    const Instrument& demo = *tick_table.find("DEMO");
+
+    OrderBook book(demo);
+
     // Scenario 1: Build initial order book
     std::cout << "Building initial order book..." << std::endl;
-    
+
     // Add sell orders
     book.addOrder(Side::SELL, OrderType::LIMIT, 100.50, 100);
     book.addOrder(Side::SELL, OrderType::LIMIT, 100.60, 150);
     book.addOrder(Side::SELL, OrderType::LIMIT, 100.70, 200);
     book.addOrder(Side::SELL, OrderType::LIMIT, 100.80, 175);
     book.addOrder(Side::SELL, OrderType::LIMIT, 100.90, 125);
-    
+
     // Add buy orders
     book.addOrder(Side::BUY, OrderType::LIMIT, 100.40, 120);
     book.addOrder(Side::BUY, OrderType::LIMIT, 100.30, 180);
     book.addOrder(Side::BUY, OrderType::LIMIT, 100.20, 150);
     book.addOrder(Side::BUY, OrderType::LIMIT, 100.10, 200);
     book.addOrder(Side::BUY, OrderType::LIMIT, 100.00, 100);
-    
+
     book.printOrderBook();
-    
+
     // Scenario 2: Market buy order (takes liquidity)
     std::cout << "\n>>> Executing MARKET BUY order for 250 shares <<<" << std::endl;
     book.addOrder(Side::BUY, OrderType::MARKET, 0, 250);
     book.printOrderBook();
     book.printRecentTrades(3);
-    
+
     // Scenario 3: Aggressive limit buy (crosses spread)
     std::cout << "\n>>> Adding LIMIT BUY at $100.65 for 180 shares (crosses spread) <<<" << std::endl;
     book.addOrder(Side::BUY, OrderType::LIMIT, 100.65, 180);
     book.printOrderBook();
     book.printRecentTrades(3);
-    
+
     // Scenario 4: Passive limit orders
     std::cout << "\n>>> Adding passive LIMIT orders <<<" << std::endl;
-    book.addOrder(Side::BUY, OrderType::LIMIT, 100.35, 100);
+    uint64_t passive_bid = book.addOrder(Side::BUY, OrderType::LIMIT, 100.35, 100);
     book.addOrder(Side::SELL, OrderType::LIMIT, 100.95, 150);
     book.printOrderBook();
-    
-    // Performance test
+
+    // Scenario 5: Amends - size down keeps queue position, reprice re-queues and may trade
+    std::cout << "\n>>> Amending 100.35 bid to 60 shares, then repricing a new 100.30 bid to 100.70 <<<" << std::endl;
+    book.modifyOrder(passive_bid, 100.35, 60);
+    uint64_t repriced_bid = book.addOrder(Side::BUY, OrderType::LIMIT, 100.30, 50);
+    book.modifyOrder(repriced_bid, 100.70, 50);
+    book.printOrderBook();
+    book.printRecentTrades(1);
+
+    // Scenario 6: Extended order types
+    std::cout << "\n>>> Iceberg SELL 300 @ $100.75 showing 100, buy stop 200 @ $100.75, "
+              << "POST_ONLY and FOK that would be rejected, then IOC BUY 200 @ $100.75 <<<" << std::endl;
+    book.addIcebergOrder(Side::SELL, 100.75, 300, 100);
+    book.addStopOrder(Side::BUY, 100.75, 200);
+    std::cout << "POST_ONLY BUY @ $100.70 (crosses): "
+              << (book.addOrder(Side::BUY, OrderType::POST_ONLY, 100.70, 10) ? "accepted" : "rejected") << std::endl;
+    uint64_t post_only_bid = book.addOrder(Side::BUY, OrderType::POST_ONLY, 100.00, 10);
+    uint64_t trades_before_reprice = book.getTotalTrades();
+    bool post_only_repriced = book.modifyOrder(post_only_bid, 100.75, 10);
+    const Order* post_only_order = book.findOrder(post_only_bid);
+    bool post_only_kept = post_only_bid && !post_only_repriced && book.getTotalTrades() == trades_before_reprice &&
+                          post_only_order && post_only_order->price == demo.toTicks(100.00);
+    std::cout << "POST_ONLY BUY @ $100.00 repriced to $100.75 (crosses): "
+              << (post_only_kept ? "refused, order left at $100.00" : "FAILED") << std::endl;
+    book.cancelOrder(post_only_bid);
+    std::cout << "FOK BUY 5000 @ $100.95: "
+              << (book.addOrder(Side::BUY, OrderType::FOK, 100.95, 5000) ? "accepted" : "rejected") << std::endl;
+    book.addOrder(Side::BUY, OrderType::IOC, 100.75, 200);
+    book.printOrderBook();
+    book.printRecentTrades(6);
+
+    // Depth queries read level totals only
+    uint64_t sweep_filled = 0;
+    double sweep_avg = book.sweepCost(Side::BUY, 500, &sweep_filled);
+    std::cout << "Ask depth within 10 ticks: " << book.depthWithin(Side::SELL, 10) << " shown, "
+              << book.depthWithin(Side::SELL, 10, true) << " with iceberg reserve; bid depth within 10 ticks: "
+              << book.depthWithin(Side::BUY, 10) << std::endl;
+    std::cout << "Sweeping 500 shares of asks: " << sweep_filled << " filled at an average $"
+              << std::fixed << std::setprecision(4) << sweep_avg << std::endl;
+
+    // Scenario 7: Closing auction - crossing orders queue, the indicative price moves with each, one uncross
+    std::cout << "\n>>> Closing auction: BUY 400 @ $101.00, SELL 300 @ $100.20, SELL 250 @ $100.60, then uncross <<<"
+              << std::endl;
+    auto show_indicative = [&](const char* label) {
+        AuctionQuote quote = book.indicativeAuction();
+        std::cout << label << ": indicative " << quote.volume << " @ $" << std::fixed << std::setprecision(2)
+                  << demo.toPrice(quote.price) << ", imbalance " << quote.imbalance << std::endl;
+    };
+    book.startAuction();
+    book.addOrder(Side::BUY, OrderType::LIMIT, 101.00, 400);
+    show_indicative("After BUY 400 @ $101.00 ");
+    book.addOrder(Side::SELL, OrderType::LIMIT, 100.20, 300);
+    show_indicative("After SELL 300 @ $100.20");
+    book.addOrder(Side::SELL, OrderType::LIMIT, 100.60, 250);
+    show_indicative("After SELL 250 @ $100.60");
+    std::cout << "MARKET BUY during the auction: "
+              << (book.addOrder(Side::BUY, OrderType::MARKET, 0, 100) ? "accepted" : "rejected") << std::endl;
+    AuctionQuote closing = book.uncross();
+    std::cout << "Uncrossed " << closing.volume << " @ $" << demo.toPrice(closing.price) << std::endl;
+    book.printOrderBook();
+
+    // Performance test: identical order stream through the map-keyed and ladder books
     std::cout << "\n=== Performance Test ===" << std::endl;
-    OrderBook perf_book;
-    
+
     std::mt19937 rng(42);
     std::uniform_real_distribution<double> price_dist(99.0, 101.0);
     std::uniform_int_distribution<uint64_t> qty_dist(10, 500);
     std::uniform_int_distribution<int> side_dist(0, 1);
-    
-    int n_orders = 100000;
+
+    struct PerfOrder { Side side; double price; uint64_t qty; };
+
+    int n_orders = 1000000;
+    std::vector<PerfOrder> flow(n_orders);
+    for (auto& o : flow) {
+        o.side = (side_dist(rng) == 0) ? Side::BUY : Side::SELL;
+        o.price = std::round(price_dist(rng) * 100) / 100.0;  // Round to cents
+        o.qty = qty_dist(rng);
+    }
+
+    MapOrderBook map_book;
     auto start = std::chrono::high_resolution_clock::now();
-    
-    for (int i = 0; i < n_orders; ++i) {
-        Side side = (side_dist(rng) == 0) ? Side::BUY : Side::SELL;
-        double price = std::round(price_dist(rng) * 100) / 100.0;  // Round to cents
-        uint64_t qty = qty_dist(rng);
-        
-        perf_book.addOrder(side, OrderType::LIMIT, price, qty);
-    }
-    
+    for (const auto& o : flow) {
+        map_book.addLimitOrder(o.side, o.price, o.qty);
+    }
     auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    
-    std::cout << "Processed " << n_orders << " orders in " << duration.count() << " ms" << std::endl;
-    std::cout << "Throughput: " << std::fixed << std::setprecision(0) 
-              << (n_orders * 1000.0 / duration.count()) << " orders/sec" << std::endl;
-    
-    perf_book.printStats();
-    
+    double map_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    OrderBook perf_book(demo);
+    start = std::chrono::high_resolution_clock::now();
+    for (const auto& o : flow) {
+        perf_book.addOrder(o.side, OrderType::LIMIT, o.price, o.qty);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double ladder_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // Same ladder book stamping every order from system_clock instead of the TSC
+    BasicOrderBook<SystemClock> sysclock_book(demo);
+    start = std::chrono::high_resolution_clock::now();
+    for (const auto& o : flow) {
+        sysclock_book.addOrder(o.side, OrderType::LIMIT, o.price, o.qty);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double sysclock_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    // Same flow through a book recording per-operation latency histograms, followed by
+    // cancels of every fifth order ID and small market orders so every category is exercised
+    TimedOrderBook timed_book(demo);
+    start = std::chrono::high_resolution_clock::now();
+    for (const auto& o : flow) {
+        timed_book.addOrder(o.side, OrderType::LIMIT, o.price, o.qty);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double timed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    for (int i = 0; i < n_orders; i += 5) {
+        timed_book.cancelOrder(static_cast<uint64_t>(i) + 1);
+        if (i % 500 == 0) timed_book.addOrder(flow[i].side, OrderType::MARKET, 0, flow[i].qty);
+    }
+
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "std::map book:    " << n_orders << " orders in " << map_ms << " ms ("
+              << (n_orders * 1000.0 / map_ms) << " orders/sec, "
+              << map_book.getTotalTrades() << " trades)" << std::endl;
+    std::cout << "Tick ladder book: " << n_orders << " orders in " << ladder_ms << " ms ("
+              << (n_orders * 1000.0 / ladder_ms) << " orders/sec, "
+              << perf_book.getTotalTrades() << " trades)" << std::endl;
+    std::cout << "Speedup: " << std::setprecision(2) << (map_ms / ladder_ms) << "x" << std::endl;
+    std::cout << "Ladder book with system_clock stamps: " << std::setprecision(0) << sysclock_ms << " ms ("
+              << (n_orders * 1000.0 / sysclock_ms) << " orders/sec)" << std::endl;
+    std::cout << "Ladder book with latency histograms: " << timed_ms << " ms ("
+              << (n_orders * 1000.0 / timed_ms) << " orders/sec)" << std::endl;
+
+    // Feed executions that fill an order whole are reductions, not cancels
+    TimedOrderBook reduce_book(demo, 1024);
+    for (int i = 0; i < 100; ++i) reduce_book.addOrder(Side::BUY, OrderType::LIMIT, 99.00 + i * 0.01, 100);
+    for (uint64_t id = 1; id <= 100; ++id) reduce_book.reduceOrder(id, 100);
+    uint64_t timed_cancels = reduce_book.latencyStats().histogram(LatencyOp::CANCEL).count();
+    std::cout << "Full reductions: " << (100 - reduce_book.getRestingOrders()) << " orders removed, "
+              << timed_cancels << " timed as cancels" << (timed_cancels == 0 && reduce_book.getRestingOrders() == 0
+                                                          ? "" : " (FAILED)") << std::endl;
+    // Nothing drains the ring, so it should hold exactly the last `capacity` trades
+    const TradeRing& perf_ring = perf_book.tradeSink();
+    bool ring_ok = perf_ring.overwrittenCount() + perf_ring.capacity() == perf_book.getTotalTrades();
+    std::cout << "Trade ring (no consumer, OVERWRITE): " << perf_ring.capacity() << " slots holding the newest of "
+              << perf_book.getTotalTrades() << " trades, " << perf_ring.overwrittenCount() << " overwritten ("
+              << (ring_ok ? "consistent" : "MISMATCH") << ")" << std::endl;
+    perf_book.printRecentTrades(3);
+
+    // Fill-event pipeline: a consumer thread drains a small BLOCK ring while matching runs
+    std::cout << "=== Trade Pipeline (consumer thread, BLOCK policy) ===" << std::endl;
+    OrderBook pipeline_book(demo, 1 << 20, 1 << 12, OverflowPolicy::BLOCK);
+    std::atomic<bool> matching_done{false};
+    uint64_t consumed = 0, consumed_volume = 0;
+    std::thread consumer([&] {
+        auto on_trade = [&](const Trade& trade) { ++consumed; consumed_volume += trade.quantity; };
+        while (true) {
+            bool done = matching_done.load(std::memory_order_acquire);
+            size_t n = pipeline_book.tradeSink().drain(on_trade);
+            if (n == 0) {
+                if (done) break;
+                std::this_thread::yield();
+            }
+        }
+    });
+    start = std::chrono::high_resolution_clock::now();
+    for (const auto& o : flow) {
+        pipeline_book.addOrder(o.side, OrderType::LIMIT, o.price, o.qty);
+    }
+    matching_done.store(true, std::memory_order_release);
+    consumer.join();
+    end = std::chrono::high_resolution_clock::now();
+    double pipeline_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << "Matched " << n_orders << " orders in " << pipeline_ms << " ms; consumer drained "
+              << consumed << " of " << pipeline_book.getTotalTrades() << " trades ("
+              << consumed_volume << " shares) through a " << pipeline_book.tradeSink().capacity()
+              << "-slot ring" << std::endl;
+
+    // A spill file that cannot be created is reported, as is every trade that missed it
+    TradeRing unspillable(16, OverflowPolicy::SPILL, "/nonexistent/trades.spill");
+    for (uint64_t i = 1; i <= 20; ++i) unspillable.onTrade(Trade(i, i, 0, 1, 0));
+    std::cout << "SPILL ring with an unwritable path: "
+              << (!unspillable.spillOk() && unspillable.spillFailedCount() == 4 ? "reported" : "FAILED") << " ("
+              << unspillable.spillFailedCount() << " trades not written)" << std::endl << std::endl;
+
+    // Wire path: the same flow encoded as NEW_ORDER messages, decoded in place into a book
+    // whose fills are encoded straight back out, with an ack per order
+    std::cout << "=== Binary Protocol ===" << std::endl;
+    MsgWriter inbound(flow.size() * sizeof(NewOrderMsg));
+    for (const auto& o : flow) {
+        inbound.newOrder(0, 0, o.side, OrderType::LIMIT, demo.toTicks(o.price), o.qty);
+    }
+    MsgWriter fills(perf_book.getTotalTrades() * sizeof(FillMsg));
+    MsgWriter acks(flow.size() * sizeof(OrderAckMsg));
+    BasicOrderBook<TscClock, WireTradeSink> wire_book(demo, 1 << 20, fills, 0);
+    BookSession<BasicOrderBook<TscClock, WireTradeSink>> session(wire_book, 0, &acks);
+    start = std::chrono::high_resolution_clock::now();
+    size_t decoded = decodeMessages(inbound.data(), inbound.size(), session);
+    end = std::chrono::high_resolution_clock::now();
+    double wire_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    struct FillCounter : MsgHandler {
+        uint64_t fills = 0, volume = 0;
+        void onFill(const FillMsg& msg) { ++fills; volume += msg.quantity; }
+    } fill_counter;
+    decodeMessages(fills.data(), fills.size(), fill_counter);
+    std::cout << std::setprecision(0) << "Decoded " << (decoded / sizeof(NewOrderMsg)) << " messages ("
+              << (inbound.size() >> 20) << " MiB) in " << wire_ms << " ms (" << (n_orders * 1000.0 / wire_ms)
+              << " msgs/sec; direct calls " << ladder_ms << " ms)" << std::endl;
+    std::cout << "Encoded " << (acks.size() / sizeof(OrderAckMsg)) << " acks and " << fill_counter.fills
+              << " fills (" << fill_counter.volume << " shares)" << std::endl;
+
+    // Malformed side and type bytes into a full book are acked REJECTED and touch nothing
+    OrderBook full_book(demo, 64);
+    Price demo_mid = demo.toTicks(demo.reference_price);
+    for (Price offset = 1; full_book.addOrderTicks(Side::BUY, OrderType::LIMIT, demo_mid - offset, 100) &&
+                           full_book.addOrderTicks(Side::SELL, OrderType::LIMIT, demo_mid + offset, 100);
+         ++offset) {}
+    MsgWriter malformed;
+    malformed.newOrder(0, 0, Side::BUY, static_cast<OrderType>(9), demo_mid, 100);
+    malformed.newOrder(0, 0, static_cast<Side>(2), OrderType::MARKET, 0, 100);
+    MsgWriter malformed_acks;
+    BookSession<OrderBook> malformed_session(full_book, 0, &malformed_acks);
+    size_t resting_before = full_book.getRestingOrders();
+    decodeMessages(malformed.data(), malformed.size(), malformed_session);
+    struct RejectCounter : MsgHandler {
+        uint64_t rejected = 0;
+        void onOrderAck(const OrderAckMsg& msg) { rejected += msg.status == static_cast<uint8_t>(AckStatus::REJECTED); }
+    } reject_counter;
+    decodeMessages(malformed_acks.data(), malformed_acks.size(), reject_counter);
+    bool malformed_ok = reject_counter.rejected == 2 && full_book.getRestingOrders() == resting_before &&
+                        full_book.getTotalTrades() == 0;
+    std::cout << "Bad side and type bytes into a full book: " << reject_counter.rejected << " of 2 rejected ("
+              << (malformed_ok ? "book untouched" : "FAILED") << ")" << std::endl << std::endl;
+
+    // Write-ahead journal: the same NEW_ORDER messages with and without journaling, then recovery
+    std::cout << "=== Write-Ahead Journal ===" << std::endl;
+    benchmarkJournal(demo, inbound, "journal_bench");
+
+    std::cout << "=== Book Snapshots ===" << std::endl;
+    benchmarkSnapshot(demo, 1000000, "book_bench.snap");
+
+    // Depth feed: the same flow through a book publishing L2 updates, polled every
+    // 1000 orders by a subscriber taking every update and one taking conflated state
+    std::cout << "=== L2 Depth Feed ===" << std::endl;
+    using L2Book = BasicOrderBook<TscClock, TradeRing, DenseIdHash, L2Publisher>;
+    struct LevelCounter : L2Handler {
+        uint64_t levels = 0, snapshots = 0;
+        void onSnapshot(uint64_t) { ++snapshots; }
+        void onLevel(const LevelUpdate&) { ++levels; }
+    } full_feed, conflated_feed;
+    L2Book l2_book(demo);
+    L2Publisher::Subscriber full_sub, conflated_sub;
+    conflated_sub.conflate = true;
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < flow.size(); ++i) {
+        l2_book.addOrder(flow[i].side, OrderType::LIMIT, flow[i].price, flow[i].qty);
+        if (i % 1000 == 999) {
+            l2_book.depthSink().poll(full_sub, full_feed);
+            l2_book.depthSink().poll(conflated_sub, conflated_feed);
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double l2_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    LevelCounter late_joiner;
+    L2Publisher::Subscriber late_sub;
+    size_t snapshot_levels = l2_book.depthSink().poll(late_sub, late_joiner);
+    std::cout << std::setprecision(0) << "Published " << l2_book.depthSink().sequence() << " level updates in "
+              << l2_ms << " ms (" << (n_orders * 1000.0 / l2_ms) << " orders/sec; no feed " << ladder_ms
+              << " ms)" << std::endl;
+    std::cout << "Every update: " << full_feed.levels << " levels; conflated: " << conflated_feed.levels
+              << " levels; late joiner snapshot: " << snapshot_levels << " levels" << std::endl << std::endl;
+
+    // Allocator share of addOrder: the heap path the map book still uses per order
+    // versus a pool record, with about as many live records as the book ends up holding
+    const size_t live_orders = 200000;
+    double heap_ns = allocatorNsPerOrder(n_orders, live_orders,
+        [] { return std::make_shared<Order>(); },
+        [](std::shared_ptr<Order>& order) { order.reset(); });
+
+    OrderPool alloc_pool(live_orders);
+    double pool_ns = allocatorNsPerOrder(n_orders, live_orders,
+        [&] { return alloc_pool.allocate(); },
+        [&](OrderHandle h) { alloc_pool.release(h); });
+
+    double map_order_ns = map_ms * 1e6 / n_orders;
+    double ladder_order_ns = ladder_ms * 1e6 / n_orders;
+    std::cout << "=== Allocator Share of addOrder ===" << std::endl;
+    std::cout << std::setprecision(1);
+    std::cout << "make_shared<Order> + release: " << heap_ns << " ns/order ("
+              << (100.0 * heap_ns / map_order_ns) << "% of " << map_order_ns << " ns map book addOrder)" << std::endl;
+    std::cout << "OrderPool allocate + release: " << pool_ns << " ns/order ("
+              << (100.0 * pool_ns / ladder_order_ns) << "% of " << ladder_order_ns << " ns ladder book addOrder)"
+              << std::endl << std::endl;
+
+    std::cout << "=== Match Kernel: Sweeping Fills ===" << std::endl;
+    OrderBook sweep_book(demo);
+    benchmarkFills(sweep_book, 200, 10, 500);
+    // Same sweeps with prevention on: every order is account 0, so this is the cost of the owner compare
+    std::cout << "With self-trade prevention enabled:" << std::endl;
+    OrderBook stp_sweep_book(demo);
+    stp_sweep_book.setSelfTradePrevention(SelfTradePrevention::CANCEL_RESTING);
+    benchmarkFills(stp_sweep_book, 200, 10, 500);
+
+    std::cout << "=== Level Allocation Policies ===" << std::endl;
+    for (int orders : {1000, 5000}) {
+        std::cout << orders << " orders at the level:" << std::endl;
+        benchmarkAllocation<OrderBook>("  FIFO:     ", demo, 100, orders);
+        benchmarkAllocation<ProRataOrderBook>("  pro-rata: ", demo, 100, orders);
+        benchmarkAllocation<HybridOrderBook>("  hybrid:   ", demo, 100, orders);
+    }
+    std::cout << std::endl;
+
+    // Ingress handoff: the same requests through SPSC (one by one and in batches) and MPSC queues
+    std::cout << "=== Ingress Queue Handoff ===" << std::endl;
+    std::vector<OrderRequest> ingress;
+    ingress.reserve(flow.size());
+    for (const auto& o : flow) {
+        ingress.push_back({OrderRequest::Kind::NEW, o.side, OrderType::LIMIT, 0, ingress.size() + 1,
+                           demo.toTicks(o.price), o.qty, {}});
+    }
+    benchmarkHandoff<SpscQueue>("SPSC, 1 producer        ", demo, ingress, 1, 1);
+    benchmarkHandoff<SpscQueue>("SPSC, 1 producer, x32   ", demo, ingress, 1, 32);
+    benchmarkHandoff<MpscQueue>("MPSC, 2 producers       ", demo, ingress, 2, 1);
+    benchmarkHandoff<MpscQueue>("MPSC, 2 producers, x32  ", demo, ingress, 2, 32);
+    std::cout << std::endl;
+
+    std::cout << "=== Pre-Trade Risk Checks ===" << std::endl;
+    benchmarkRisk(demo, ingress, 1000);
+
+    std::cout << "=== Self-Trade Prevention ===" << std::endl;
+    benchmarkSelfTrade(demo, ingress, 4);
+
+    std::cout << "=== Call Auction ===" << std::endl;
+    benchmarkAuction(demo, ingress);
+
+    // Multi-symbol engine: 64 instruments sharded over matching threads
+    std::cout << "=== Sharded Engine Scaling ===" << std::endl;
+    std::vector<Instrument> universe;
+    for (int i = 0; i < 64; ++i) {
+        universe.push_back({"SYM" + std::to_string(i), 0.01, 50.00 + i, 1000});
+    }
+    benchmarkShards(universe, n_orders, std::max(4u, std::thread::hardware_concurrency()));
+
+    // Latency percentiles for the timed book, and its full histograms as CSV when asked for
+    timed_book.printStats();
+    if (!latency_csv_path.empty()) {
+        std::ofstream latency_csv(latency_csv_path);
+        timed_book.latencyStats().dump(latency_csv);
+        std::cout << "Latency histograms " << (latency_csv ? "written to " : "could not be written to ")
+                  << latency_csv_path << std::endl;
+    }
+
     return 0;
 }
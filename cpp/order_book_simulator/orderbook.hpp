@@ -0,0 +1,4257 @@
+/**
+ * @file orderbook.hpp
+ * @brief High-performance limit order book matching engine
+ *
+ * Features:
+ * - Price-time priority matching, or pro-rata and top-order/pro-rata allocation as a compile-time policy
+ * - Market, Limit, IOC, FOK, post-only, iceberg, stop and stop-limit orders
+ * - Cancel and Modify (priority-preserving quantity reductions)
+ * - Integer tick prices with a per-instrument tick-size table
+ * - Array-indexed price ladder (O(1) level lookup)
+ * - Cached best prices and a two-level occupancy bitmap for next-level search
+ * - Intrusive doubly-linked FIFO per level (O(1) cancel and fill removal)
+ * - Preallocated open-addressing order-ID index
+ * - Cache-line-aligned slab of Order records addressed by 32-bit handles
+ * - Sequence-number time priority and one TSC timestamp per inbound message
+ * - Bounded trade-event ring (or user-supplied sink) instead of unbounded history
+ * - Multi-symbol engine sharding books across pinned matching threads
+ * - Lock-free SPSC (per gateway) and MPSC ingress queues with batch push and drain
+ * - Fixed-layout little-endian binary protocol with an in-place decoder and encoder
+ * - Running per-level displayed and hidden quantity, with O(levels) depth and sweep-cost queries
+ * - Incremental L2 feed with snapshots and conflation
+ * - Write-ahead journal on mmap'd segments with an I/O thread, group commit and replay recovery
+ * - Binary book snapshots (quiescent or forked copy-on-write) loaded by mmap plus level-pointer fix-ups
+ * - Optional HDR-style latency histograms per operation (adds by levels swept, market, cancel, modify)
+ * - Optional O(1) per-account pre-trade risk checks (size, notional, open orders, position, credit, price band)
+ * - Self-trade prevention in the match kernel (cancel resting, cancel aggressor, cancel both, decrement)
+ * - Call auctions with an O(log levels) indicative uncrossing price and a one-pass uncross
+ *
+ * Header-only; included by the simulator (orderbook.cpp), the replay tool (replay.cpp),
+ * the mixed-workload benchmark (bench.cpp) and the agent-based simulator (sim.cpp).
+ */
+
+#ifndef ORDERBOOK_HPP
+#define ORDERBOOK_HPP
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Prices are carried as signed integer multiples of the instrument tick size
+using Price = int64_t;
+
+// Order types
+enum class OrderType : uint8_t {
+    LIMIT,       // Match up to the limit price, rest the remainder
+    MARKET,      // Match at any price, never rest
+    IOC,         // Immediate-or-cancel: match up to the limit price, drop the remainder
+    FOK,         // Fill-or-kill: fill completely up to the limit price or do nothing
+    POST_ONLY,   // Rest without trading; rejected if it would cross
+    ICEBERG,     // Limit order showing at most display_quantity, reserve replenished from hidden
+    STOP,        // Held until the last trade reaches the stop price, then a MARKET order
+    STOP_LIMIT   // Held until the last trade reaches the stop price, then a LIMIT order
+};
+
+/**
+ * @struct OrderOptions
+ * @brief Order parameters beyond side, type, price and quantity; fields not used by the order type are ignored
+ */
+struct OrderOptions {
+    Price stop_price = 0;           // STOP, STOP_LIMIT: trigger price in ticks
+    uint64_t display_quantity = 0;  // ICEBERG: visible peak size
+    uint32_t account = 0;           // Owning account, for risk limits
+};
+
+/**
+ * @brief What the match kernel does when an incoming order meets a resting order of the same account
+ *
+ * Account 0 means no owner and never triggers prevention.
+ */
+enum class SelfTradePrevention : uint8_t {
+    NONE,              // Trade as usual
+    CANCEL_RESTING,    // Cancel the resting order and keep matching (cancel oldest)
+    CANCEL_AGGRESSOR,  // Cancel the rest of the incoming order (cancel newest)
+    CANCEL_BOTH,       // Cancel both
+    DECREMENT          // Take the smaller quantity off both without a trade; an order left with none is cancelled
+};
+
+// Match-kernel policies per order type: whether the order stops at its limit
+// price and whether an unfilled remainder rests on the book
+struct MarketTraits {
+    static constexpr bool price_limited = false;
+    static constexpr bool rests = false;
+};
+
+struct ImmediateTraits {  // IOC, FOK
+    static constexpr bool price_limited = true;
+    static constexpr bool rests = false;
+};
+
+struct LimitTraits {  // LIMIT, POST_ONLY, ICEBERG
+    static constexpr bool price_limited = true;
+    static constexpr bool rests = true;
+};
+
+/**
+ * @struct FifoAllocation
+ * @brief Allocation policy: an aggressor fills a price level's orders strictly oldest first
+ */
+struct FifoAllocation {
+    static constexpr bool pro_rata = false;
+    static constexpr bool top_order = false;
+};
+
+/**
+ * @struct BasicProRataAllocation
+ * @brief Allocation policy: an aggressor smaller than a level splits in proportion to displayed size
+ *
+ * Each order's share is the incoming quantity times its displayed quantity
+ * over the level's, rounded down; shares under `min_allocation` round to
+ * zero. The rounding remainder then goes out in time priority. With
+ * `TopOrder` (hybrid), the oldest order at the level first takes up to
+ * `top_order_cap` before the split. An aggressor at least as large as the
+ * level fills it whole, as under FIFO.
+ */
+template <bool TopOrder>
+struct BasicProRataAllocation {
+    static constexpr bool pro_rata = true;
+    static constexpr bool top_order = TopOrder;
+
+    uint64_t min_allocation = 2;           // Smallest non-zero pro-rata share
+    uint64_t top_order_cap = UINT64_MAX;   // Hybrid only: most the oldest order takes ahead of the split
+
+    // Share of `incoming` for an order showing `quantity` at a level showing `level_quantity`
+    uint64_t share(uint64_t incoming, uint64_t quantity, uint64_t level_quantity) const {
+        // 64-bit divide whenever the product fits; the 128-bit one is a library call
+        unsigned __int128 product = static_cast<unsigned __int128>(incoming) * quantity;
+        uint64_t s = (product >> 64) == 0 ? static_cast<uint64_t>(product) / level_quantity
+                                          : static_cast<uint64_t>(product / level_quantity);
+        return s >= min_allocation ? s : 0;
+    }
+};
+
+using ProRataAllocation = BasicProRataAllocation<false>;
+using HybridAllocation = BasicProRataAllocation<true>;  // Top order, then pro-rata
+
+enum class Side : uint8_t {
+    BUY,
+    SELL
+};
+
+/**
+ * @struct Instrument
+ * @brief Static description of a traded instrument
+ *
+ * The book holds `ladder_ticks` price levels on each side of `reference_price`;
+ * limit orders priced outside that band are rejected.
+ */
+struct Instrument {
+    std::string symbol;
+    double tick_size;        // Minimum price increment
+    double reference_price;  // Centre of the price ladder
+    Price ladder_ticks;      // Levels held above and below the reference
+
+    // Convert a decimal price to ticks (rounded to the nearest tick)
+    Price toTicks(double price) const {
+        return static_cast<Price>(std::llround(price / tick_size));
+    }
+
+    // Convert ticks back to a decimal price (for display only)
+    double toPrice(Price ticks) const {
+        return static_cast<double>(ticks) * tick_size;
+    }
+};
+
+/**
+ * @class TickSizeTable
+ * @brief Per-instrument tick sizes and ladder geometry, looked up by symbol
+ */
+class TickSizeTable {
+private:
+    std::vector<Instrument> instruments;
+
+public:
+    void add(const Instrument& instrument) {
+        instruments.push_back(instrument);
+    }
+
+    const Instrument* find(const std::string& symbol) const {
+        for (const auto& instrument : instruments) {
+            if (instrument.symbol == symbol) return &instrument;
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * @struct SystemClock
+ * @brief Timestamp policy reading std::chrono::system_clock (a vDSO call per read)
+ */
+struct SystemClock {
+    uint64_t now() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+};
+
+/**
+ * @struct TscClock
+ * @brief Timestamp policy reading the CPU timestamp counter, scaled to wall-clock ns
+ *
+ * The TSC-to-nanosecond rate and the epoch offset are measured once per process
+ * against system_clock; afterwards a read is rdtsc plus a multiply-add.
+ * Falls back to steady_clock where rdtsc is unavailable.
+ */
+class TscClock {
+private:
+    struct Calibration {
+        uint64_t tsc0;
+        uint64_t wall0_ns;
+        double ns_per_tick;
+    };
+
+    static uint64_t readTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    static Calibration calibrate() {
+        SystemClock wall;
+        uint64_t tsc0 = readTsc();
+        uint64_t wall0 = wall.now();
+        // Spin ~10 ms so the rate error is well under a microsecond per second
+        uint64_t wall1 = wall0;
+        while (wall1 - wall0 < 10000000) wall1 = wall.now();
+        uint64_t tsc1 = readTsc();
+        return {tsc1, wall1, static_cast<double>(wall1 - wall0) / static_cast<double>(tsc1 - tsc0)};
+    }
+
+    static const Calibration& calibration() {
+        static const Calibration cal = calibrate();
+        return cal;
+    }
+
+    Calibration cal = calibration();
+
+public:
+    uint64_t now() const {
+        return cal.wall0_ns + static_cast<uint64_t>(static_cast<double>(readTsc() - cal.tsc0) * cal.ns_per_tick);
+    }
+
+    // Raw counter for interval timing; scale differences by nsPerTick()
+    static uint64_t ticks() { return readTsc(); }
+    static double nsPerTick() { return calibration().ns_per_tick; }
+};
+
+struct PriceLevel;
+
+// Index of an Order record in the OrderPool slab
+using OrderHandle = uint32_t;
+constexpr OrderHandle kNullHandle = UINT32_MAX;
+
+// Account number no order carries; the match kernel's self-trade key when prevention is off
+constexpr uint32_t kNoAccount = UINT32_MAX;
+
+/**
+ * @struct Order
+ * @brief Order record, linked intrusively into its price level's queue
+ *
+ * Two cache lines: everything the match loop reads or writes sits in the
+ * first, type-specific and informational fields in the second.
+ */
+struct alignas(64) Order {
+    uint64_t order_id = 0;
+    Price price = 0;                 // Limit price (unused for MARKET and STOP)
+    uint64_t quantity = 0;           // Open quantity; for an ICEBERG, the displayed part
+    uint64_t hidden_quantity = 0;    // ICEBERG reserve not yet displayed
+    uint64_t sequence = 0;           // Engine sequence number of the accepting message (time priority)
+    PriceLevel* level = nullptr;     // Level the order rests on, null while not resting
+    OrderHandle prev = kNullHandle;  // Toward the front of the queue (older)
+    OrderHandle next = kNullHandle;  // Toward the back of the queue (newer); free-list link in the pool
+    Side side = Side::BUY;
+    OrderType type = OrderType::LIMIT;
+    uint32_t account = 0;            // Owning account
+
+    alignas(64) uint64_t timestamp = 0;  // Wall-clock ns of the accepting message
+    Price stop_price = 0;                // STOP, STOP_LIMIT trigger
+    uint64_t display_quantity = 0;       // ICEBERG peak size
+
+    Order() = default;
+    Order(uint64_t id, Side s, OrderType t, Price p, uint64_t q, uint64_t seq = 0, uint64_t ts = 0)
+        : order_id(id), price(p), quantity(q), sequence(seq), side(s), type(t), timestamp(ts) {}
+};
+
+/**
+ * @class OrderPool
+ * @brief Fixed-capacity slab of Order records with an intrusive free list
+ *
+ * Records are cache-line aligned and are addressed by 32-bit handles;
+ * allocate and release are a couple of loads and stores, never a heap call.
+ */
+class OrderPool {
+private:
+    std::vector<Order> slab;
+    OrderHandle free_head;
+    size_t in_use = 0;
+    size_t high_water = 0;  // Records [high_water, capacity) have never been handed out
+
+public:
+    explicit OrderPool(size_t capacity)
+        : slab(capacity), free_head(capacity > 0 ? 0 : kNullHandle) {
+        for (size_t i = 0; i < capacity; ++i) {
+            slab[i].next = (i + 1 < capacity) ? static_cast<OrderHandle>(i + 1) : kNullHandle;
+        }
+    }
+
+    /**
+     * @brief Take a record off the free list; returns kNullHandle when exhausted
+     */
+    OrderHandle allocate() {
+        OrderHandle h = free_head;
+        if (h != kNullHandle) {
+            free_head = slab[h].next;
+            ++in_use;
+            if (h >= high_water) high_water = h + 1;
+        }
+        return h;
+    }
+
+    void release(OrderHandle h) {
+        slab[h].level = nullptr;
+        slab[h].next = free_head;
+        free_head = h;
+        --in_use;
+    }
+
+    Order& operator[](OrderHandle h) { return slab[h]; }
+    const Order& operator[](OrderHandle h) const { return slab[h]; }
+
+    size_t size() const { return in_use; }
+    size_t capacity() const { return slab.size(); }
+    bool full() const { return free_head == kNullHandle; }
+
+    // Snapshot support: records below the high-water mark, free list included, are
+    // the pool's whole state, and handles make them valid at any address
+    size_t highWater() const { return high_water; }
+    OrderHandle freeHead() const { return free_head; }
+    const Order* data() const { return slab.data(); }
+
+    /**
+     * @brief Replace the pool's state with `n` records saved from a pool of the same capacity
+     *
+     * Records from `n` up return to their never-used state. Level pointers in
+     * the copied records are stale until the owner fixes them up.
+     */
+    void restore(const Order* records, size_t n, OrderHandle free_head_, size_t in_use_) {
+        std::memcpy(static_cast<void*>(slab.data()), records, n * sizeof(Order));
+        for (size_t i = n; i < high_water; ++i) {
+            slab[i] = Order();
+            slab[i].next = (i + 1 < slab.size()) ? static_cast<OrderHandle>(i + 1) : kNullHandle;
+        }
+        free_head = free_head_;
+        in_use = in_use_;
+        high_water = n;
+    }
+};
+
+// Trade execution record
+struct Trade {
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    Price price;
+    uint64_t quantity;
+    uint64_t timestamp;  // Taken from the aggressing order's message
+
+    Trade() = default;
+    Trade(uint64_t bid, uint64_t sid, Price p, uint64_t q, uint64_t ts)
+        : buy_order_id(bid), sell_order_id(sid), price(p), quantity(q), timestamp(ts) {}
+};
+
+// What TradeRing does with a trade when every slot is still undrained
+enum class OverflowPolicy {
+    BLOCK,     // Wait for the consumer to free a slot
+    DROP,      // Discard the new trade and count it
+    SPILL,     // Append the trade to the spill file and count it
+    OVERWRITE  // Replace the oldest undrained trade and count it; consumer must be the matching thread
+};
+
+/**
+ * @class TradeRing
+ * @brief Fixed-size single-producer/single-consumer ring of fill events
+ *
+ * The matching thread publishes with onTrade(); a downstream consumer (same or
+ * another thread) calls drain(). Memory is allocated once, so matching latency
+ * never includes container growth. Slots keep their contents after draining,
+ * which lets forEachRecent() show the last trades for display.
+ *
+ * The default OVERWRITE policy suits a ring nobody drains, or one drained on
+ * the matching thread: it always holds the newest trades, and drain() skips
+ * whatever was overwritten. A consumer on another thread needs BLOCK, DROP or
+ * SPILL, since an overwrite could race with its read of the slot.
+ *
+ * Any type with `void onTrade(const Trade&)` can replace it as the book's sink.
+ */
+class TradeRing {
+private:
+    std::vector<Trade> slots;
+    size_t mask;
+    OverflowPolicy policy;
+    std::FILE* spill_file = nullptr;
+
+    alignas(64) std::atomic<uint64_t> write_pos{0};  // Written by the producer
+    uint64_t cached_read = 0;                        // Producer's last view of read_pos
+    uint64_t dropped = 0;
+    uint64_t spilled = 0;
+    uint64_t spill_failed = 0;                       // Spilled trades that never reached the file
+    uint64_t overwritten = 0;
+
+    alignas(64) std::atomic<uint64_t> read_pos{0};   // Written by the consumer
+
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two
+     * @param policy_ Behaviour when the consumer falls a full ring behind
+     * @param spill_path File that receives raw Trade records under OverflowPolicy::SPILL;
+     *        check spillOk() after construction
+     */
+    explicit TradeRing(size_t capacity = 1 << 16, OverflowPolicy policy_ = OverflowPolicy::OVERWRITE,
+                       const std::string& spill_path = "trades.spill")
+        : policy(policy_) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+        if (policy == OverflowPolicy::SPILL) spill_file = std::fopen(spill_path.c_str(), "wb");
+    }
+
+    ~TradeRing() {
+        if (spill_file) std::fclose(spill_file);
+    }
+
+    TradeRing(const TradeRing&) = delete;
+    TradeRing& operator=(const TradeRing&) = delete;
+
+    /**
+     * @brief Publish a fill (producer side)
+     */
+    void onTrade(const Trade& trade) {
+        uint64_t w = write_pos.load(std::memory_order_relaxed);
+        if (w - cached_read > mask) {
+            cached_read = read_pos.load(std::memory_order_acquire);
+            while (w - cached_read > mask) {
+                if (policy == OverflowPolicy::OVERWRITE) {
+                    ++overwritten;
+                    break;
+                }
+                if (policy == OverflowPolicy::DROP) {
+                    ++dropped;
+                    return;
+                }
+                if (policy == OverflowPolicy::SPILL) {
+                    if (spill_file && std::fwrite(&trade, sizeof(Trade), 1, spill_file) == 1) {
+                        ++spilled;
+                    } else {
+                        ++spill_failed;
+                    }
+                    return;
+                }
+                std::this_thread::yield();
+                cached_read = read_pos.load(std::memory_order_acquire);
+            }
+        }
+        slots[w & mask] = trade;
+        write_pos.store(w + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Hand up to `max` undrained trades to `f` in fill order (consumer side)
+     *
+     * Under OVERWRITE, trades overwritten since the last drain are skipped
+     * (see overwrittenCount).
+     *
+     * @return Number of trades consumed
+     */
+    template <typename F>
+    size_t drain(F&& f, size_t max = SIZE_MAX) {
+        uint64_t r = read_pos.load(std::memory_order_relaxed);
+        uint64_t w = write_pos.load(std::memory_order_acquire);
+        if (w - r > slots.size()) r = w - slots.size();
+        size_t n = static_cast<size_t>(std::min<uint64_t>(w - r, max));
+        for (size_t i = 0; i < n; ++i) f(slots[(r + i) & mask]);
+        read_pos.store(r + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * @brief Visit the last `n` trades held by the ring, oldest first, drained or not
+     *
+     * These are the newest trades unless a DROP, SPILL or BLOCK ring has been
+     * left undrained. Call from the producer thread (or with matching paused).
+     */
+    template <typename F>
+    void forEachRecent(size_t n, F&& f) const {
+        uint64_t w = write_pos.load(std::memory_order_acquire);
+        n = static_cast<size_t>(std::min<uint64_t>({n, w, slots.size()}));
+        for (uint64_t i = w - n; i < w; ++i) f(slots[i & mask]);
+    }
+
+    size_t capacity() const { return slots.size(); }
+    OverflowPolicy overflowPolicy() const { return policy; }
+    uint64_t droppedCount() const { return dropped; }
+    uint64_t spilledCount() const { return spilled; }
+    uint64_t spillFailedCount() const { return spill_failed; }
+    uint64_t overwrittenCount() const { return overwritten; }
+
+    // False if the SPILL file could not be opened or a spill write failed
+    bool spillOk() const { return policy != OverflowPolicy::SPILL || (spill_file && spill_failed == 0); }
+};
+
+/**
+ * @struct PriceLevel
+ * @brief Queue of orders at one price (FIFO for time priority)
+ *
+ * Orders are linked through their own prev/next handles, so appending, popping
+ * the front and unlinking from the middle (cancel) are all O(1). The level
+ * keeps running totals of its displayed and hidden (iceberg reserve)
+ * quantity; whoever changes a resting order's quantities in place adjusts
+ * them too.
+ */
+struct PriceLevel {
+    OrderHandle head = kNullHandle;  // Oldest order, matched first
+    OrderHandle tail = kNullHandle;  // Newest order
+    uint32_t order_count = 0;
+    uint64_t quantity = 0;           // Sum of the queued orders' displayed quantity
+    uint64_t hidden_quantity = 0;    // Sum of the queued orders' iceberg reserves
+
+    bool empty() const { return head == kNullHandle; }
+
+    void pushBack(OrderPool& pool, OrderHandle h) {
+        Order& order = pool[h];
+        order.prev = tail;
+        order.next = kNullHandle;
+        order.level = this;
+        if (tail != kNullHandle) {
+            pool[tail].next = h;
+        } else {
+            head = h;
+        }
+        tail = h;
+        ++order_count;
+        quantity += order.quantity;
+        hidden_quantity += order.hidden_quantity;
+    }
+
+    void remove(OrderPool& pool, OrderHandle h) {
+        Order& order = pool[h];
+        if (order.prev != kNullHandle) {
+            pool[order.prev].next = order.next;
+        } else {
+            head = order.next;
+        }
+        if (order.next != kNullHandle) {
+            pool[order.next].prev = order.prev;
+        } else {
+            tail = order.prev;
+        }
+        order.prev = order.next = kNullHandle;
+        order.level = nullptr;
+        --order_count;
+        quantity -= order.quantity;
+        hidden_quantity -= order.hidden_quantity;
+    }
+};
+
+/**
+ * @class PriceLadder
+ * @brief Contiguous array of price levels indexed by tick offset from the lowest price
+ *
+ * Level lookup is a subtraction and an index; walking the book moves to the
+ * adjacent element instead of chasing tree pointers.
+ *
+ * Non-empty levels are tracked in a two-level bitmap: one bit per level in
+ * `occupied`, and one bit per non-zero `occupied` word in `summary`. Finding
+ * the next non-empty level in either direction is a masked word test plus a
+ * count-trailing/leading-zeros, however many empty levels lie between.
+ */
+class PriceLadder {
+private:
+    Price min_price;
+    std::vector<PriceLevel> levels;
+    std::vector<uint64_t> occupied;  // Bit (i & 63) of word (i >> 6): level i non-empty
+    std::vector<uint64_t> summary;   // Bit (w & 63) of word (w >> 6): occupied[w] != 0
+
+    static constexpr size_t npos = SIZE_MAX;
+
+    size_t indexOf(const PriceLevel* level) const { return static_cast<size_t>(level - levels.data()); }
+
+    void setOccupied(size_t i) {
+        size_t w = i >> 6;
+        if (occupied[w] == 0) summary[w >> 6] |= 1ULL << (w & 63);
+        occupied[w] |= 1ULL << (i & 63);
+    }
+
+    void clearOccupied(size_t i) {
+        size_t w = i >> 6;
+        occupied[w] &= ~(1ULL << (i & 63));
+        if (occupied[w] == 0) summary[w >> 6] &= ~(1ULL << (w & 63));
+    }
+
+    // Lowest non-empty level index >= i, or npos
+    size_t findUp(size_t i) const {
+        if (i >= levels.size()) return npos;
+        size_t w = i >> 6;
+        uint64_t bits = occupied[w] & (~0ULL << (i & 63));
+        if (bits) return (w << 6) + __builtin_ctzll(bits);
+
+        size_t next_w = w + 1;
+        if (next_w >= occupied.size()) return npos;
+        size_t s = next_w >> 6;
+        uint64_t sbits = summary[s] & (~0ULL << (next_w & 63));
+        while (sbits == 0) {
+            if (++s >= summary.size()) return npos;
+            sbits = summary[s];
+        }
+        w = (s << 6) + __builtin_ctzll(sbits);
+        return (w << 6) + __builtin_ctzll(occupied[w]);
+    }
+
+    // Highest non-empty level index <= i, or npos
+    size_t findDown(size_t i) const {
+        if (i == npos) return npos;
+        size_t w = i >> 6;
+        uint64_t bits = occupied[w] & (~0ULL >> (63 - (i & 63)));
+        if (bits) return (w << 6) + 63 - __builtin_clzll(bits);
+
+        if (w == 0) return npos;
+        size_t prev_w = w - 1;
+        size_t s = prev_w >> 6;
+        uint64_t sbits = summary[s] & (~0ULL >> (63 - (prev_w & 63)));
+        while (sbits == 0) {
+            if (s == 0) return npos;
+            sbits = summary[--s];
+        }
+        w = (s << 6) + 63 - __builtin_clzll(sbits);
+        return (w << 6) + 63 - __builtin_clzll(occupied[w]);
+    }
+
+public:
+    PriceLadder(Price min_price_, Price max_price_)
+        : min_price(min_price_), levels(static_cast<size_t>(max_price_ - min_price_ + 1)) {
+        occupied.resize((levels.size() + 63) / 64);
+        summary.resize((occupied.size() + 63) / 64);
+    }
+
+    Price minPrice() const { return min_price; }
+    Price maxPrice() const { return min_price + static_cast<Price>(levels.size()) - 1; }
+
+    // Snapshot support: levels hold only handles and totals, so the level
+    // array and both bitmaps copy to and from an image byte for byte
+    template <typename F>
+    void forEachSection(F&& f) const {
+        f(static_cast<const void*>(levels.data()), levels.size() * sizeof(PriceLevel));
+        f(static_cast<const void*>(occupied.data()), occupied.size() * sizeof(uint64_t));
+        f(static_cast<const void*>(summary.data()), summary.size() * sizeof(uint64_t));
+    }
+
+    template <typename F>
+    void forEachSection(F&& f) {
+        f(static_cast<void*>(levels.data()), levels.size() * sizeof(PriceLevel));
+        f(static_cast<void*>(occupied.data()), occupied.size() * sizeof(uint64_t));
+        f(static_cast<void*>(summary.data()), summary.size() * sizeof(uint64_t));
+    }
+
+    bool contains(Price price) const {
+        return price >= min_price && price <= maxPrice();
+    }
+
+    PriceLevel& at(Price price) { return levels[static_cast<size_t>(price - min_price)]; }
+    const PriceLevel& at(Price price) const { return levels[static_cast<size_t>(price - min_price)]; }
+
+    /**
+     * @brief Append an order to the queue at `price`, marking the level non-empty
+     */
+    void pushBack(OrderPool& pool, Price price, OrderHandle h) {
+        PriceLevel& level = at(price);
+        if (level.empty()) setOccupied(static_cast<size_t>(price - min_price));
+        level.pushBack(pool, h);
+    }
+
+    /**
+     * @brief Unlink a resting order from its level, clearing the level's bit if it empties
+     */
+    void remove(OrderPool& pool, OrderHandle h) {
+        PriceLevel* level = pool[h].level;
+        level->remove(pool, h);
+        if (level->empty()) clearOccupied(indexOf(level));
+    }
+
+    /**
+     * @brief Lowest non-empty price >= `price`, or maxPrice() + 1 if none
+     */
+    Price nextAtOrAbove(Price price) const {
+        size_t i = findUp(price < min_price ? 0 : static_cast<size_t>(price - min_price));
+        return i == npos ? maxPrice() + 1 : min_price + static_cast<Price>(i);
+    }
+
+    /**
+     * @brief Highest non-empty price <= `price`, or minPrice() - 1 if none
+     */
+    Price nextAtOrBelow(Price price) const {
+        if (price < min_price) return min_price - 1;
+        size_t i = findDown(price > maxPrice() ? levels.size() - 1 : static_cast<size_t>(price - min_price));
+        return i == npos ? min_price - 1 : min_price + static_cast<Price>(i);
+    }
+};
+
+// Hash for engine-assigned order IDs: dense and increasing, so the identity
+// spreads any window of live IDs over consecutive slots without collisions
+struct DenseIdHash {
+    uint64_t operator()(uint64_t id) const { return id; }
+};
+
+// Hash for externally assigned (client or exchange) IDs with arbitrary structure
+struct MixedIdHash {
+    uint64_t operator()(uint64_t id) const {
+        id ^= id >> 33;
+        id *= 0xff51afd7ed558ccdULL;
+        id ^= id >> 33;
+        id *= 0xc4ceb9fe1a85ec53ULL;
+        id ^= id >> 33;
+        return id;
+    }
+};
+
+/**
+ * @class OrderIdIndex
+ * @brief Flat open-addressing map from order ID to value
+ *
+ * Robin Hood linear probing over a power-of-two slot array sized once at
+ * construction (at most half full at the configured capacity), so lookups
+ * touch one or two cache lines and nothing allocates after startup. Entries
+ * in a probe run stay ordered by distance from their home slot, which lets a
+ * miss stop early and lets erase back-shift only up to the next entry already
+ * at home instead of leaving tombstones. ID 0 marks an empty slot.
+ */
+template <typename V, typename Hash = DenseIdHash>
+class OrderIdIndex {
+private:
+    struct Slot {
+        uint64_t key = 0;
+        V value{};
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+    size_t capacity;
+    size_t count = 0;
+    Hash hash;
+
+    static constexpr size_t npos = SIZE_MAX;
+
+    size_t home(uint64_t key) const { return hash(key) & mask; }
+
+    // How far the occupant of slot i sits from its home slot
+    size_t probeDistance(size_t i) const { return (i - home(slots[i].key)) & mask; }
+
+    size_t findSlot(uint64_t key) const {
+        size_t i = home(key);
+        for (size_t dist = 0;; ++dist, i = (i + 1) & mask) {
+            if (slots[i].key == key) return i;
+            if (slots[i].key == 0 || probeDistance(i) < dist) return npos;
+        }
+    }
+
+public:
+    explicit OrderIdIndex(size_t capacity_)
+        : capacity(capacity_) {
+        size_t n = 16;
+        while (n < capacity_ * 2) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    size_t size() const { return count; }
+    bool full() const { return count >= capacity; }
+
+    void clear() {
+        std::fill(slots.begin(), slots.end(), Slot{});
+        count = 0;
+    }
+
+    /**
+     * @brief Insert or overwrite a key; returns false if a new key would exceed capacity
+     */
+    bool insert(uint64_t key, V value) {
+        size_t found = findSlot(key);
+        if (found != npos) {
+            slots[found].value = value;
+            return true;
+        }
+        if (full()) return false;
+        ++count;
+
+        // Displace any occupant closer to its home than the entry being placed
+        Slot entry{key, value};
+        size_t i = home(key);
+        for (size_t dist = 0;; ++dist, i = (i + 1) & mask) {
+            if (slots[i].key == 0) {
+                slots[i] = entry;
+                return true;
+            }
+            size_t occupant_dist = probeDistance(i);
+            if (occupant_dist < dist) {
+                std::swap(entry, slots[i]);
+                dist = occupant_dist;
+            }
+        }
+    }
+
+    /**
+     * @brief Look up a key; returns nullptr if absent
+     */
+    V* find(uint64_t key) {
+        size_t i = findSlot(key);
+        return i != npos ? &slots[i].value : nullptr;
+    }
+
+    const V* find(uint64_t key) const {
+        size_t i = findSlot(key);
+        return i != npos ? &slots[i].value : nullptr;
+    }
+
+    // Start loading the slot a lookup of `key` probes first
+    void prefetch(uint64_t key) const { __builtin_prefetch(&slots[home(key)]); }
+
+    /**
+     * @brief Remove a key, back-shifting the rest of its probe run
+     */
+    bool erase(uint64_t key) {
+        size_t i = findSlot(key);
+        if (i == npos) return false;
+
+        size_t j = (i + 1) & mask;
+        while (slots[j].key != 0 && probeDistance(j) > 0) {
+            slots[i] = slots[j];
+            i = j;
+            j = (j + 1) & mask;
+        }
+        slots[i].key = 0;
+        slots[i].value = V{};
+        --count;
+        return true;
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (const auto& slot : slots) {
+            if (slot.key != 0) f(slot.key, slot.value);
+        }
+    }
+};
+
+/**
+ * @struct LevelUpdate
+ * @brief New aggregate state of one price level
+ */
+struct LevelUpdate {
+    uint64_t sequence;     // Publisher sequence number of the change
+    Price price;
+    uint64_t quantity;     // Total displayed quantity at the level; 0 once it empties
+    uint32_t order_count;
+    Side side;
+};
+
+/**
+ * @struct NullDepthSink
+ * @brief Depth policy that publishes nothing; the book's level updates compile away
+ *
+ * Any type constructible from the book's Instrument and providing
+ * `void onLevelUpdate(Side, Price, uint64_t quantity, uint32_t order_count)`
+ * can replace it (see L2Publisher).
+ */
+struct NullDepthSink {
+    explicit NullDepthSink(const Instrument&) {}
+    void onLevelUpdate(Side, Price, uint64_t, uint32_t) {}
+};
+
+/**
+ * @struct L2Handler
+ * @brief No-op callbacks for L2Publisher::poll; derive and redeclare the ones needed
+ */
+struct L2Handler {
+    void onSnapshot(uint64_t) {}  // Discard all levels; a full image as of this sequence follows
+    void onLevel(const LevelUpdate&) {}
+};
+
+/**
+ * @class L2Publisher
+ * @brief Incremental price-level feed with snapshots and per-subscriber conflation
+ *
+ * Plugged into a book as its DepthSink, it receives one update per level that
+ * an add, fill, cancel or modify changes. Each update is O(1): it overwrites
+ * the level's entry in a flat state table and appends to a fixed ring of
+ * recent updates. Nothing allocates after construction.
+ *
+ * Subscribers read at their own pace with poll(). A subscriber that has just
+ * joined, or that the ring has overtaken, is sent a snapshot of every
+ * non-empty level before it resumes with updates. A conflating subscriber is
+ * sent each changed level once, at its latest state, instead of every
+ * intermediate update.
+ *
+ * Not thread-safe: poll from the matching thread, or with matching paused.
+ */
+class L2Publisher {
+public:
+    struct Subscriber {
+        uint64_t cursor = 0;    // Last sequence delivered
+        bool synced = false;    // Has had a snapshot and is within the ring
+        bool conflate = false;  // Latest state per changed level only
+    };
+
+private:
+    struct LevelState {
+        uint64_t quantity = 0;
+        uint64_t sequence = 0;  // Sequence of the level's latest update
+        uint32_t order_count = 0;
+    };
+
+    Price min_price;
+    std::vector<LevelState> levels[2];   // Per side, indexed by tick offset
+    std::vector<uint64_t> occupied[2];   // Bit per non-empty level, walked by snapshots
+    std::vector<LevelUpdate> ring;
+    size_t mask;
+    uint64_t published = 0;
+    uint64_t snapshots_sent = 0;
+
+    static size_t sideIndex(Side side) { return side == Side::BUY ? 0 : 1; }
+
+    const LevelState& stateOf(Side side, Price price) const {
+        return levels[sideIndex(side)][static_cast<size_t>(price - min_price)];
+    }
+
+public:
+    /**
+     * @param ring_capacity Updates retained for subscribers that fall behind, rounded up to a power of two
+     */
+    explicit L2Publisher(const Instrument& instrument, size_t ring_capacity = 1 << 16)
+        : min_price(instrument.toTicks(instrument.reference_price) - instrument.ladder_ticks) {
+        size_t n_levels = static_cast<size_t>(2 * instrument.ladder_ticks + 1);
+        for (size_t s = 0; s < 2; ++s) {
+            levels[s].resize(n_levels);
+            occupied[s].resize((n_levels + 63) / 64);
+        }
+        size_t n = 1;
+        while (n < ring_capacity) n <<= 1;
+        ring.resize(n);
+        mask = n - 1;
+    }
+
+    void onLevelUpdate(Side side, Price price, uint64_t quantity, uint32_t order_count) {
+        size_t s = sideIndex(side);
+        size_t i = static_cast<size_t>(price - min_price);
+        uint64_t seq = ++published;
+        levels[s][i] = {quantity, seq, order_count};
+        if (order_count > 0) {
+            occupied[s][i >> 6] |= 1ULL << (i & 63);
+        } else {
+            occupied[s][i >> 6] &= ~(1ULL << (i & 63));
+        }
+        ring[seq & mask] = {seq, price, quantity, order_count, side};
+    }
+
+    /**
+     * @brief Send `handler` every non-empty level, bids best-first then asks best-first
+     *
+     * Usable on its own as a periodic snapshot channel; the image is
+     * consistent as of sequence(), which is passed to onSnapshot() first.
+     *
+     * @return Levels sent
+     */
+    template <typename Handler>
+    size_t snapshot(Handler& handler) {
+        handler.onSnapshot(published);
+        ++snapshots_sent;
+        size_t n = 0;
+        for (size_t w = occupied[0].size(); w-- > 0;) {
+            for (uint64_t bits = occupied[0][w]; bits; bits &= ~(1ULL << (63 - __builtin_clzll(bits)))) {
+                size_t i = (w << 6) + 63 - __builtin_clzll(bits);
+                const LevelState& level = levels[0][i];
+                handler.onLevel({published, min_price + static_cast<Price>(i), level.quantity, level.order_count, Side::BUY});
+                ++n;
+            }
+        }
+        for (size_t w = 0; w < occupied[1].size(); ++w) {
+            for (uint64_t bits = occupied[1][w]; bits; bits &= bits - 1) {
+                size_t i = (w << 6) + __builtin_ctzll(bits);
+                const LevelState& level = levels[1][i];
+                handler.onLevel({published, min_price + static_cast<Price>(i), level.quantity, level.order_count, Side::SELL});
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    /**
+     * @brief Bring `sub` up to date: a snapshot if it needs one, then the updates it has not seen
+     * @return Levels sent
+     */
+    template <typename Handler>
+    size_t poll(Subscriber& sub, Handler& handler) {
+        size_t n = 0;
+        if (!sub.synced || published - sub.cursor > ring.size()) {
+            n += snapshot(handler);
+            sub.cursor = published;
+            sub.synced = true;
+        }
+        for (uint64_t seq = sub.cursor + 1; seq <= published; ++seq) {
+            const LevelUpdate& update = ring[seq & mask];
+            if (sub.conflate && stateOf(update.side, update.price).sequence != seq) continue;
+            handler.onLevel(update);
+            ++n;
+        }
+        sub.cursor = published;
+        return n;
+    }
+
+    uint64_t sequence() const { return published; }
+    uint64_t snapshotCount() const { return snapshots_sent; }
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Log-linear (HDR-style) histogram of TSC tick intervals
+ *
+ * Every power of two is split into 32 equal sub-buckets, so a value is held
+ * to within about 3% at any magnitude. Recording is a leading-zero count, a
+ * shift and an increment into a table allocated once.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 5;
+    static constexpr uint64_t kSubBuckets = 1ULL << kSubBits;
+    static constexpr int kMaxExponent = 40;  // Intervals of 2^41 ticks or more share the last bucket
+    static constexpr size_t kBuckets = static_cast<size_t>(kMaxExponent - kSubBits + 2) << kSubBits;
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t max_value = 0;
+
+public:
+    LatencyHistogram() : counts(kBuckets, 0) {}
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < kSubBuckets) return static_cast<size_t>(value);
+        int exponent = 63 - __builtin_clzll(value);
+        if (exponent > kMaxExponent) return kBuckets - 1;
+        return (static_cast<size_t>(exponent - kSubBits + 1) << kSubBits) +
+               static_cast<size_t>((value >> (exponent - kSubBits)) - kSubBuckets);
+    }
+
+    // Smallest and largest values that fall into `bucket`
+    static uint64_t bucketLow(size_t bucket) {
+        size_t row = bucket >> kSubBits;
+        if (row == 0) return bucket;
+        return ((bucket & (kSubBuckets - 1)) + kSubBuckets) << (row - 1);
+    }
+
+    static uint64_t bucketHigh(size_t bucket) {
+        size_t row = bucket >> kSubBits;
+        return bucketLow(bucket) + (row == 0 ? 0 : (1ULL << (row - 1)) - 1);
+    }
+
+    void record(uint64_t value) {
+        ++counts[bucketOf(value)];
+        ++total;
+        if (value > max_value) max_value = value;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_value; }
+
+    /**
+     * @brief Upper bound of the bucket holding the `q` quantile (0 < q <= 1), capped at the exact maximum
+     */
+    uint64_t percentile(double q) const {
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < kBuckets; ++b) {
+            seen += counts[b];
+            if (seen >= rank) return std::min(bucketHigh(b), max_value);
+        }
+        return max_value;
+    }
+
+    // Call f(low, high, count) for every non-empty bucket, lowest first
+    template <typename F>
+    void forEachBucket(F&& f) const {
+        for (size_t b = 0; b < kBuckets; ++b) {
+            if (counts[b]) f(bucketLow(b), bucketHigh(b), counts[b]);
+        }
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        max_value = 0;
+    }
+};
+
+// Book operations timed by LatencyRecorder; crossing adds are split by price levels swept
+enum class LatencyOp : uint8_t {
+    ADD_RESTING,       // Accepted add that traded nothing (rested, or an IOC with no contra)
+    ADD_CROSS_1,       // Add that traded at one level
+    ADD_CROSS_2,
+    ADD_CROSS_3_4,
+    ADD_CROSS_5_PLUS,
+    MARKET,
+    CANCEL,
+    MODIFY,
+    COUNT
+};
+
+/**
+ * @struct NullLatency
+ * @brief Latency policy that records nothing; the book's timing calls compile away
+ */
+struct NullLatency {
+    static constexpr bool enabled = false;
+    uint64_t start() const { return 0; }
+    void record(LatencyOp, uint64_t) {}
+};
+
+/**
+ * @class LatencyRecorder
+ * @brief Latency policy keeping one LatencyHistogram per LatencyOp
+ *
+ * Times each public book call with two raw TSC reads and converts to
+ * nanoseconds only when reporting. Rejected adds are not recorded; a failed
+ * cancel or modify (unknown ID) is, since production sees those too.
+ */
+class LatencyRecorder {
+private:
+    LatencyHistogram histograms[static_cast<size_t>(LatencyOp::COUNT)];
+
+public:
+    static constexpr bool enabled = true;
+
+    static const char* name(LatencyOp op) {
+        static const char* const names[] = {"add_resting", "add_cross_1", "add_cross_2", "add_cross_3_4",
+                                            "add_cross_5_plus", "market", "cancel", "modify"};
+        return names[static_cast<size_t>(op)];
+    }
+
+    uint64_t start() const { return TscClock::ticks(); }
+
+    void record(LatencyOp op, uint64_t started) {
+        histograms[static_cast<size_t>(op)].record(TscClock::ticks() - started);
+    }
+
+    const LatencyHistogram& histogram(LatencyOp op) const { return histograms[static_cast<size_t>(op)]; }
+
+    void reset() {
+        for (auto& h : histograms) h.reset();
+    }
+
+    /**
+     * @brief Print count and p50/p99/p99.9/max in ns for every operation recorded at least once
+     */
+    void print(std::ostream& out) const {
+        double ns = TscClock::nsPerTick();
+        out << std::left << std::setw(18) << "Latency (ns)" << std::right << std::setw(10) << "count"
+            << std::setw(8) << "p50" << std::setw(8) << "p99" << std::setw(8) << "p99.9" << std::setw(10) << "max"
+            << std::endl;
+        out << std::fixed << std::setprecision(0);
+        for (size_t i = 0; i < static_cast<size_t>(LatencyOp::COUNT); ++i) {
+            const LatencyHistogram& h = histograms[i];
+            if (h.count() == 0) continue;
+            out << std::left << std::setw(18) << name(static_cast<LatencyOp>(i)) << std::right
+                << std::setw(10) << h.count() << std::setw(8) << h.percentile(0.50) * ns
+                << std::setw(8) << h.percentile(0.99) * ns << std::setw(8) << h.percentile(0.999) * ns
+                << std::setw(10) << h.max() * ns << std::endl;
+        }
+    }
+
+    /**
+     * @brief Write every non-empty bucket as CSV rows `op,low_ns,high_ns,count` (bucket edges) after a header
+     */
+    void dump(std::ostream& out) const {
+        double ns = TscClock::nsPerTick();
+        out << "op,low_ns,high_ns,count\n";
+        out << std::fixed << std::setprecision(1);
+        for (size_t i = 0; i < static_cast<size_t>(LatencyOp::COUNT); ++i) {
+            const char* op = name(static_cast<LatencyOp>(i));
+            histograms[i].forEachBucket([&](uint64_t low, uint64_t high, uint64_t n) {
+                out << op << ',' << low * ns << ',' << (high + 1) * ns << ',' << n << '\n';
+            });
+        }
+    }
+};
+
+// Why an order failed a pre-trade risk check
+enum class RiskReject : uint8_t {
+    NONE,
+    UNKNOWN_ACCOUNT,  // Account number beyond the risk table
+    ORDER_SIZE,       // Quantity above max_order_quantity
+    ORDER_NOTIONAL,   // Price * quantity above max_order_notional
+    OPEN_ORDERS,      // Account already has max_open_orders resting
+    POSITION,         // Position if every open order on this side filled would exceed max_position
+    CREDIT,           // Buying power: open buy notional plus net cash paid would exceed credit_limit
+    PRICE_BAND        // Limit price further than the collar from the last trade
+};
+
+/**
+ * @struct RiskLimits
+ * @brief Per-account pre-trade limits; notionals are price ticks times quantity
+ */
+struct RiskLimits {
+    uint64_t max_order_quantity = UINT64_MAX;
+    int64_t max_order_notional = INT64_MAX;
+    uint32_t max_open_orders = UINT32_MAX;
+    int64_t max_position = INT64_MAX;  // Absolute net position, long or short
+    int64_t credit_limit = INT64_MAX;
+};
+
+/**
+ * @struct RiskAccount
+ * @brief An account's limits and running exposure, kept on two cache lines
+ *
+ * Open quantity and notional cover resting orders and untriggered stops,
+ * iceberg reserves included.
+ */
+struct alignas(64) RiskAccount {
+    RiskLimits limits;
+    int64_t position = 0;           // Filled buys minus filled sells
+    int64_t cash = 0;               // Notional paid for buys minus notional received for sells
+    uint64_t open_buy_quantity = 0;
+    uint64_t open_sell_quantity = 0;
+    int64_t open_buy_notional = 0;
+    uint32_t open_orders = 0;
+};
+
+/**
+ * @struct NullRisk
+ * @brief Risk policy that checks and tracks nothing; the book's risk calls compile away
+ */
+struct NullRisk {
+    static constexpr bool enabled = false;
+    RiskReject check(uint32_t, Side, OrderType, Price, uint64_t, Price, bool, Price) const { return RiskReject::NONE; }
+    void onRest(const Order&) {}
+    void onRemove(const Order&) {}
+    void onReduce(const Order&, uint64_t) {}
+    void onFill(uint32_t, Side, Price, uint64_t) {}
+    void onRestingFill(const Order&, Price, uint64_t) {}
+};
+
+/**
+ * @class RiskTable
+ * @brief Risk policy: flat per-account table of limits and exposure, checked in O(1)
+ *
+ * Accounts are indexed directly by number; an order for an account beyond
+ * the table is rejected. check() reads one account and compares each limit
+ * against the order plus the exposure already open, so a rejection costs a
+ * few loads and compares and touches nothing else. The book reports every
+ * order that rests or leaves the book and every fill, on both sides.
+ *
+ * A price band, when set, rejects limit prices more than that many ticks
+ * from the last trade (not applied before the first trade).
+ */
+class RiskTable {
+private:
+    std::vector<RiskAccount> accounts;
+    Price band_ticks = 0;  // 0 = no collar
+
+    // Price used for an order's exposure: a stop's trigger stands in for a market price
+    static Price exposurePrice(const Order& order) {
+        return order.type == OrderType::STOP ? order.stop_price : order.price;
+    }
+
+    // Only orders that can rest (or wait in the trigger book) count against max_open_orders
+    static bool canRest(OrderType type) {
+        return type != OrderType::MARKET && type != OrderType::IOC && type != OrderType::FOK;
+    }
+
+    void open(const Order& order, int64_t quantity) {
+        RiskAccount& a = accounts[order.account];
+        if (order.side == Side::BUY) {
+            a.open_buy_quantity += quantity;
+            a.open_buy_notional += quantity * exposurePrice(order);
+        } else {
+            a.open_sell_quantity += quantity;
+        }
+    }
+
+public:
+    static constexpr bool enabled = true;
+
+    explicit RiskTable(size_t n_accounts = 4096) : accounts(n_accounts) {}
+
+    void setLimits(uint32_t account, const RiskLimits& limits) { accounts.at(account).limits = limits; }
+    void setPriceBand(Price ticks) { band_ticks = ticks; }
+
+    const RiskAccount& account(uint32_t account) const { return accounts.at(account); }
+    size_t size() const { return accounts.size(); }
+
+    /**
+     * @brief Pre-trade check of an incoming order (or of a modify's new price and quantity)
+     *
+     * @param value_price Price to value the order at: its limit, or for market
+     *        and stop orders an estimate supplied by the book
+     */
+    RiskReject check(uint32_t account, Side side, OrderType type, Price price, uint64_t order_quantity,
+                     Price value_price, bool has_last_trade, Price last_trade) const {
+        if (account >= accounts.size()) return RiskReject::UNKNOWN_ACCOUNT;
+        const RiskAccount& a = accounts[account];
+        int64_t quantity = static_cast<int64_t>(order_quantity);
+        int64_t notional = quantity * value_price;
+        if (order_quantity > a.limits.max_order_quantity) return RiskReject::ORDER_SIZE;
+        if (notional > a.limits.max_order_notional) return RiskReject::ORDER_NOTIONAL;
+        if (canRest(type) && a.open_orders >= a.limits.max_open_orders) return RiskReject::OPEN_ORDERS;
+        if (side == Side::BUY) {
+            if (a.position + static_cast<int64_t>(a.open_buy_quantity) + quantity > a.limits.max_position) {
+                return RiskReject::POSITION;
+            }
+            if (a.cash + a.open_buy_notional + notional > a.limits.credit_limit) return RiskReject::CREDIT;
+        } else if (static_cast<int64_t>(a.open_sell_quantity) + quantity - a.position > a.limits.max_position) {
+            return RiskReject::POSITION;
+        }
+        if (band_ticks > 0 && has_last_trade && type != OrderType::MARKET && type != OrderType::STOP &&
+            (price > last_trade + band_ticks || price < last_trade - band_ticks)) {
+            return RiskReject::PRICE_BAND;
+        }
+        return RiskReject::NONE;
+    }
+
+    // An order joined the book (or trigger book) with all of its open quantity
+    void onRest(const Order& order) {
+        ++accounts[order.account].open_orders;
+        open(order, static_cast<int64_t>(order.quantity + order.hidden_quantity));
+    }
+
+    // An order left the book, with whatever quantity it still had open
+    void onRemove(const Order& order) {
+        --accounts[order.account].open_orders;
+        open(order, -static_cast<int64_t>(order.quantity + order.hidden_quantity));
+    }
+
+    // A resting order was reduced in place by `quantity`
+    void onReduce(const Order& order, uint64_t quantity) { open(order, -static_cast<int64_t>(quantity)); }
+
+    // A fill of `quantity` at `price` for the account on `side`
+    void onFill(uint32_t account, Side side, Price price, uint64_t quantity) {
+        RiskAccount& a = accounts[account];
+        int64_t q = static_cast<int64_t>(quantity);
+        a.position += side == Side::BUY ? q : -q;
+        a.cash += side == Side::BUY ? q * price : -q * price;
+    }
+
+    // A fill against a resting order: its account's position moves and its open quantity shrinks
+    void onRestingFill(const Order& resting, Price price, uint64_t quantity) {
+        onFill(resting.account, resting.side, price, quantity);
+        open(resting, -static_cast<int64_t>(quantity));
+    }
+};
+
+// Continuous price-time matching, or a call auction in which orders rest
+// without matching until the book is uncrossed in one step
+enum class TradingPhase : uint8_t {
+    CONTINUOUS,
+    AUCTION
+};
+
+/**
+ * @struct AuctionQuote
+ * @brief Indicative (or final) result of a call auction
+ */
+struct AuctionQuote {
+    Price price = 0;        // Uncrossing price in ticks; meaningless when volume is 0
+    uint64_t volume = 0;    // Quantity that trades at `price`
+    int64_t imbalance = 0;  // Bid quantity at or above `price` minus ask quantity at or below it
+};
+
+/**
+ * @class AuctionCurves
+ * @brief Cumulative bid and ask depth over a ladder's prices, for call-auction uncrossing
+ *
+ * Two Fenwick trees hold each side's quantity per price (displayed plus
+ * hidden), so an order arriving or leaving is O(log levels) and any point of
+ * either cumulative curve is a prefix sum. The bid tree is shifted up one
+ * slot, which lines a bid prefix up with "bids strictly below p" and lets a
+ * single descent over both trees find the highest price at which cumulative
+ * demand still covers cumulative supply. The uncrossing price lies there or
+ * one tick above, so quote() is one descent plus a few bitmap lookups. The
+ * trees are interleaved, so each descent step reads one cache line.
+ */
+class AuctionCurves {
+private:
+    struct Node {
+        uint64_t bids = 0;  // Slot i + 2 covers bid quantity at min_price + i
+        uint64_t asks = 0;  // Slot i + 1 covers ask quantity at min_price + i
+    };
+
+    Price min_price;
+    std::vector<Node> tree;
+    uint64_t total_bids = 0;
+    size_t top_step = 1;     // Highest power of two <= size()
+    mutable size_t hint = 0; // Where the last quote's descent ended
+
+    size_t size() const { return tree.size() - 1; }
+
+    template <uint64_t Node::*Side_>
+    void add(size_t slot, uint64_t delta) {
+        for (; slot < tree.size(); slot += slot & (~slot + 1)) tree[slot].*Side_ += delta;
+    }
+
+    static uint64_t levelQuantity(const PriceLadder& ladder, Price price) {
+        const PriceLevel& level = ladder.at(price);
+        return level.quantity + level.hidden_quantity;
+    }
+
+    static uint64_t quantityAt(const PriceLadder& ladder, Price price) {
+        return ladder.contains(price) ? levelQuantity(ladder, price) : 0;
+    }
+
+    // Best of the prices [lo, hi], which share one volume and imbalance: the
+    // surplus side's extreme (highest for bids, lowest for asks), or the one
+    // closest to `reference` when balanced
+    static Price pick(Price lo, Price hi, int64_t imbalance, Price reference) {
+        if (imbalance > 0) return hi;
+        if (imbalance < 0) return lo;
+        return std::clamp(reference, lo, hi);
+    }
+
+public:
+    AuctionCurves(Price min_price_, Price max_price_)
+        : min_price(min_price_), tree(static_cast<size_t>(max_price_ - min_price_) + 3) {
+        while (top_step * 2 <= size()) top_step *= 2;
+    }
+
+    void clear() {
+        std::fill(tree.begin(), tree.end(), Node{});
+        total_bids = 0;
+    }
+
+    // Quantity at `price` on `side` changed by `delta` (may be negative)
+    void update(Side side, Price price, int64_t delta) {
+        size_t offset = static_cast<size_t>(price - min_price);
+        if (side == Side::BUY) {
+            add<&Node::bids>(offset + 2, static_cast<uint64_t>(delta));
+            total_bids += static_cast<uint64_t>(delta);
+        } else {
+            add<&Node::asks>(offset + 1, static_cast<uint64_t>(delta));
+        }
+    }
+
+    /**
+     * @brief Uncrossing price and volume: maximum executable volume, then
+     *        minimum imbalance, then market pressure, then nearest `reference`
+     *
+     * `bids` and `asks` are the book's ladders whose quantities the curves
+     * track. O(log levels).
+     */
+    AuctionQuote quote(const PriceLadder& bids, const PriceLadder& asks, Price reference) const {
+        // Largest slot p with (bids below price p) + (asks at or below price p) <= all bids,
+        // i.e. the highest price where demand D(p) >= supply S(p). Try the
+        // last answer first: checking it is a prefix sum whose loads are
+        // independent, where the descent is a chain of dependent ones.
+        size_t pos = hint;
+        uint64_t below = 0;   // Bids strictly below the price at `pos`
+        uint64_t supply = 0;  // Asks at or below it
+        for (size_t slot = pos; slot > 0; slot &= slot - 1) {
+            below += tree[slot].bids;
+            supply += tree[slot].asks;
+        }
+        Price at = min_price + static_cast<Price>(pos);
+        bool still_highest = below + supply <= total_bids &&
+                             (pos == size() ||
+                              below + supply + quantityAt(bids, at - 1) + quantityAt(asks, at) > total_bids);
+        if (!still_highest) {
+            pos = 0;
+            below = supply = 0;
+            for (size_t step = top_step; step > 0; step >>= 1) {
+                size_t next = pos + step;
+                if (next <= size() && below + tree[next].bids + supply + tree[next].asks <= total_bids) {
+                    pos = next;
+                    below += tree[next].bids;
+                    supply += tree[next].asks;
+                }
+            }
+            hint = pos;
+        }
+
+        Price max_price = bids.maxPrice();
+        AuctionQuote best;
+        // Prices up to p1 = min_price + pos - 1: volume is supply S(p), largest at p1
+        if (pos > 0) {
+            Price p1 = std::min(min_price + static_cast<Price>(pos) - 1, max_price);
+            uint64_t demand = total_bids - below;
+            if (supply > 0) {
+                Price lo = std::max(asks.nextAtOrBelow(p1), bids.nextAtOrBelow(p1 - 1) + 1);
+                int64_t imbalance = static_cast<int64_t>(demand - supply);
+                best = {pick(lo, p1, imbalance, reference), supply, imbalance};
+            }
+        }
+        // Prices above p1: volume is demand D(p), largest at p1 + 1
+        Price p2 = min_price + static_cast<Price>(pos);
+        if (p2 <= max_price) {
+            uint64_t demand = total_bids - below - (pos > 0 ? levelQuantity(bids, p2 - 1) : 0);
+            uint64_t supply_p2 = supply + levelQuantity(asks, p2);
+            if (demand > 0) {
+                Price hi = std::min(bids.nextAtOrAbove(p2), asks.nextAtOrAbove(p2 + 1) - 1);
+                int64_t imbalance = static_cast<int64_t>(demand) - static_cast<int64_t>(supply_p2);
+                AuctionQuote above{pick(p2, hi, imbalance, reference), demand, imbalance};
+                uint64_t gap = std::llabs(imbalance), best_gap = std::llabs(best.imbalance);
+                if (above.volume > best.volume ||
+                    (above.volume == best.volume && (gap < best_gap ||
+                     (gap == best_gap && std::llabs(above.price - reference) < std::llabs(best.price - reference))))) {
+                    best = above;
+                }
+            }
+        }
+        return best;
+    }
+};
+
+/**
+ * @struct SnapshotHeader
+ * @brief Leads a book snapshot image; the ladders and pool records follow it
+ *
+ * Image layout: this header, then for bids, asks, buy stops and sell stops
+ * each ladder's level array, occupancy bitmap and summary bitmap, then pool
+ * records [0, pool_high_water). The geometry fields must match the loading
+ * book exactly.
+ */
+struct SnapshotHeader {
+    char magic[8];              // "OBSNAP2"
+    uint32_t order_size;        // sizeof(Order)
+    uint32_t level_size;        // sizeof(PriceLevel)
+    Price min_price;
+    Price max_price;
+    uint64_t pool_capacity;
+    uint64_t pool_high_water;
+    uint64_t pool_in_use;
+    uint32_t free_head;
+    uint32_t reserved;
+    uint64_t next_order_id;
+    uint64_t next_sequence;
+    uint64_t total_orders_processed;
+    uint64_t total_trades;
+    Price last_trade_price;
+    Price best_bid;
+    Price best_ask;
+    uint64_t journal_sequence;  // Last journal record reflected in the image
+};
+
+/**
+ * @class BasicOrderBook
+ * @brief Limit order book with price-time priority matching
+ *
+ * Every inbound message takes the next engine sequence number, which orders
+ * queue priority exactly, and one read of `Clock`; fills inherit the
+ * aggressor's timestamp rather than reading the clock again.
+ *
+ * Fills go to `TradeSink::onTrade`, called inline from the match loop.
+ * `IdHash` hashes order IDs in the index: the identity DenseIdHash suits the
+ * book's own sequential IDs, MixedIdHash IDs taken from outside (feeds).
+ * `DepthSink::onLevelUpdate` receives the new aggregate of every bid or ask
+ * level a message changes, once per level per message.
+ * `Latency` times adds, cancels and modifies (LatencyRecorder) or nothing
+ * (NullLatency, the default). `Risk` applies per-account pre-trade limits
+ * (RiskTable) or none (NullRisk, the default). `Allocation` divides an
+ * aggressor among the orders at a price level: FifoAllocation (the
+ * default), ProRataAllocation or HybridAllocation.
+ */
+template <typename Clock = TscClock, typename TradeSink = TradeRing, typename IdHash = DenseIdHash,
+          typename DepthSink = NullDepthSink, typename Latency = NullLatency, typename Risk = NullRisk,
+          typename Allocation = FifoAllocation>
+class BasicOrderBook {
+private:
+    Instrument instrument;
+
+    // Price levels for each side, indexed by tick
+    PriceLadder bids;
+    PriceLadder asks;
+
+    // Trigger book: untriggered stops queued by stop price
+    PriceLadder buy_stops;
+    PriceLadder sell_stops;
+
+    // Cached best prices, kept current on every insert, fill and cancel;
+    // best_bid < minPrice() / best_ask > maxPrice() when a side is empty
+    Price best_bid;
+    Price best_ask;
+
+    // Storage for resting orders
+    OrderPool pool;
+
+    // Resting order lookup by ID
+    OrderIdIndex<OrderHandle, IdHash> order_index;
+
+    // Fill events
+    TradeSink trade_sink;
+
+    // Level updates
+    DepthSink depth_sink;
+
+    Clock clock;
+
+    // Per-operation latency, and the price levels the current add has swept
+    Latency latency_stats;
+    uint32_t levels_swept = 0;
+
+    // Pre-trade limits and exposure per account, and why the last add or modify failed them
+    Risk risk_table;
+    RiskReject last_reject = RiskReject::NONE;
+
+    SelfTradePrevention stp_mode = SelfTradePrevention::NONE;
+    uint64_t self_trades_prevented = 0;
+
+    // How an aggressor is divided among a level's orders
+    Allocation allocation_policy;
+
+    // Call auction state; the depth curves are kept only while the phase is AUCTION
+    TradingPhase phase = TradingPhase::CONTINUOUS;
+    AuctionCurves auction_curves;
+
+    uint64_t next_order_id = 1;
+    uint64_t next_sequence = 1;
+    uint64_t total_orders_processed = 0;
+    uint64_t total_trades = 0;
+
+    Price last_trade_price = 0;
+
+    // Visit the four ladders in snapshot-image order
+    template <typename F>
+    void forEachLadder(F&& f) const {
+        f(bids);
+        f(asks);
+        f(buy_stops);
+        f(sell_stops);
+    }
+
+    template <typename F>
+    void forEachLadder(F&& f) {
+        f(bids);
+        f(asks);
+        f(buy_stops);
+        f(sell_stops);
+    }
+
+    // Write all of `n` bytes to `fd`
+    static bool writeAll(int fd, const void* data, size_t n) {
+        const char* p = static_cast<const char*>(data);
+        while (n > 0) {
+            ssize_t written = ::write(fd, p, n);
+            if (written <= 0) return false;
+            p += written;
+            n -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Write the snapshot image to `tmp_path`, sync it and rename it to `path`
+     *
+     * Makes only system calls and never allocates, so it is safe in a child
+     * forked from a multi-threaded process.
+     */
+    bool writeSnapshot(const char* tmp_path, const char* path, uint64_t journal_sequence) const {
+        if (phase == TradingPhase::AUCTION) return false;  // The image has no room for a crossed book
+        SnapshotHeader header{};
+        std::memcpy(header.magic, "OBSNAP2", 8);
+        header.order_size = sizeof(Order);
+        header.level_size = sizeof(PriceLevel);
+        header.min_price = bids.minPrice();
+        header.max_price = bids.maxPrice();
+        header.pool_capacity = pool.capacity();
+        header.pool_high_water = pool.highWater();
+        header.pool_in_use = pool.size();
+        header.free_head = pool.freeHead();
+        header.next_order_id = next_order_id;
+        header.next_sequence = next_sequence;
+        header.total_orders_processed = total_orders_processed;
+        header.total_trades = total_trades;
+        header.last_trade_price = last_trade_price;
+        header.best_bid = best_bid;
+        header.best_ask = best_ask;
+        header.journal_sequence = journal_sequence;
+
+        int fd = ::open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = writeAll(fd, &header, sizeof(header));
+        forEachLadder([&](const PriceLadder& ladder) {
+            ladder.forEachSection([&](const void* data, size_t n) { ok = ok && writeAll(fd, data, n); });
+        });
+        ok = ok && writeAll(fd, pool.data(), pool.highWater() * sizeof(Order));
+        ok = ok && ::fsync(fd) == 0;
+        ok = (::close(fd) == 0) && ok;
+        return ok && ::rename(tmp_path, path) == 0;
+    }
+
+    bool hasBids() const { return best_bid >= bids.minPrice(); }
+    bool hasAsks() const { return best_ask <= asks.maxPrice(); }
+
+    // Move best bid down to the next non-empty level
+    void refreshBestBid() {
+        best_bid = bids.nextAtOrBelow(best_bid);
+    }
+
+    // Move best ask up to the next non-empty level
+    void refreshBestAsk() {
+        best_ask = asks.nextAtOrAbove(best_ask);
+    }
+
+    // Side accessors: the book an order of side S matches against, resolved at compile time
+    template <Side S> PriceLadder& contra() { if constexpr (S == Side::BUY) return asks; else return bids; }
+    template <Side S> bool hasContra() const { if constexpr (S == Side::BUY) return hasAsks(); else return hasBids(); }
+    template <Side S> Price bestContra() const { if constexpr (S == Side::BUY) return best_ask; else return best_bid; }
+    template <Side S> void refreshBestContra() { if constexpr (S == Side::BUY) refreshBestAsk(); else refreshBestBid(); }
+
+    // Report a bid or ask level's current aggregate to the depth sink
+    void publishLevel(Side side, const PriceLevel& level, Price price) {
+        depth_sink.onLevelUpdate(side, price, level.quantity, level.order_count);
+    }
+
+    // Keep the auction depth curves in step with a resting quantity change
+    void auctionDepth(Side side, Price price, int64_t delta) {
+        if (phase == TradingPhase::AUCTION) auction_curves.update(side, price, delta);
+    }
+
+    // Does a level at `price` satisfy an aggressor of side S limited at `limit`?
+    template <Side S>
+    static bool withinLimit(Price limit, Price price) {
+        if constexpr (S == Side::BUY) return price <= limit; else return price >= limit;
+    }
+
+    /**
+     * @brief Match an incoming order of side S against the opposite book
+     *
+     * Trades at the resting level's price in price-time order until the order
+     * is filled, the opposite side is empty, or, for price-limited types, the
+     * best opposite level is beyond the order's limit.
+     */
+    template <Side S, typename Traits>
+    void match(Order& order) {
+        PriceLadder& book = contra<S>();
+        // Resting orders of this account are not traded against; one compare per fill
+        uint32_t self = (stp_mode != SelfTradePrevention::NONE && order.account != 0) ? order.account : kNoAccount;
+        while (hasContra<S>() && order.quantity > 0) {
+            Price price = bestContra<S>();
+            if constexpr (Traits::price_limited) {
+                if (!withinLimit<S>(order.price, price)) break;
+            }
+            if constexpr (Latency::enabled) ++levels_swept;
+
+            PriceLevel& level = book.at(price);
+            if constexpr (Allocation::pro_rata) {
+                if (order.quantity < level.quantity) allocateProRata<S>(book, level, price, order, self);
+            }
+            // The whole level under FIFO; under pro-rata a level the order takes
+            // whole, or the rounding remainder of the split
+            while (!level.empty() && order.quantity > 0) {
+                OrderHandle resting_handle = level.head;
+                fill<S>(book, level, price, order, resting_handle,
+                        std::min(order.quantity, pool[resting_handle].quantity), self);
+            }
+            publishLevel(S == Side::BUY ? Side::SELL : Side::BUY, level, price);
+
+            // Move past emptied price level
+            refreshBestContra<S>();
+        }
+    }
+
+    /**
+     * @brief Trade `trade_qty` between the aggressor and one resting order at `price`,
+     *        or apply self-trade prevention if the resting order is the aggressor's own
+     */
+    template <Side S>
+    void fill(PriceLadder& book, PriceLevel& level, Price price, Order& order, OrderHandle resting_handle,
+              uint64_t trade_qty, uint32_t self) {
+        Order& resting = pool[resting_handle];
+        if (resting.account == self) {
+            preventSelfTrade(book, level, order, resting_handle, trade_qty);
+            return;
+        }
+
+        // Trade records name the buyer first
+        if constexpr (S == Side::BUY) {
+            trade_sink.onTrade(Trade(order.order_id, resting.order_id, price, trade_qty, order.timestamp));
+        } else {
+            trade_sink.onTrade(Trade(resting.order_id, order.order_id, price, trade_qty, order.timestamp));
+        }
+        total_trades++;
+        last_trade_price = price;
+        if constexpr (Risk::enabled) {
+            risk_table.onFill(order.account, S, price, trade_qty);
+            risk_table.onRestingFill(resting, price, trade_qty);
+        }
+
+        order.quantity -= trade_qty;
+        resting.quantity -= trade_qty;
+        level.quantity -= trade_qty;
+
+        // Remove filled order
+        if (resting.quantity == 0) exhaust(book, resting_handle, order.sequence);
+    }
+
+    /**
+     * @brief Split an aggressor smaller than the level across its orders by displayed size
+     *
+     * One walk from head to the current tail with no scratch space: each
+     * share is computed against the level as it stood before the split and
+     * filled on the spot. A refilled iceberg peak moves behind the tail and
+     * is not visited twice. The hybrid policy's top order fills first. The
+     * caller hands out the rounding remainder in time priority.
+     */
+    template <Side S>
+    void allocateProRata(PriceLadder& book, PriceLevel& level, Price price, Order& order, uint32_t self) {
+        if constexpr (Allocation::top_order) {
+            OrderHandle top = level.head;
+            fill<S>(book, level, price, order, top,
+                    std::min({order.quantity, pool[top].quantity, allocation_policy.top_order_cap}), self);
+            if (order.quantity == 0 || level.empty() || order.quantity >= level.quantity) return;
+        }
+
+        uint64_t incoming = order.quantity;
+        uint64_t level_quantity = level.quantity;
+        OrderHandle h = level.head;
+        OrderHandle last = level.tail;
+        while (order.quantity > 0) {
+            OrderHandle next = pool[h].next;
+            bool at_last = h == last;
+            uint64_t share = allocation_policy.share(incoming, pool[h].quantity, level_quantity);
+            if (share > 0) fill<S>(book, level, price, order, h, std::min(share, order.quantity), self);
+            if (at_last) break;
+            h = next;
+        }
+    }
+
+    /**
+     * @brief A resting order's displayed quantity ran out: refill an iceberg peak or remove the order
+     */
+    void exhaust(PriceLadder& ladder, OrderHandle h, uint64_t sequence) {
+        if (pool[h].hidden_quantity > 0) {
+            replenishIceberg(ladder, h, sequence);
+        } else {
+            removeResting(ladder, h);
+        }
+    }
+
+    // Unlink, unindex and free a resting order, whatever it has left
+    void removeResting(PriceLadder& ladder, OrderHandle h) {
+        risk_table.onRemove(pool[h]);
+        order_index.erase(pool[h].order_id);
+        ladder.remove(pool, h);
+        pool.release(h);
+    }
+
+    /**
+     * @brief Apply the book's self-trade mode to an aggressor meeting its own resting order
+     *
+     * Cancelling the aggressor zeroes its open quantity, which ends matching
+     * and keeps any remainder off the book.
+     */
+    void preventSelfTrade(PriceLadder& ladder, PriceLevel& level, Order& order, OrderHandle h, uint64_t quantity) {
+        ++self_trades_prevented;
+        switch (stp_mode) {
+            case SelfTradePrevention::DECREMENT:
+                order.quantity -= quantity;
+                pool[h].quantity -= quantity;
+                level.quantity -= quantity;
+                risk_table.onReduce(pool[h], quantity);
+                if (pool[h].quantity == 0) exhaust(ladder, h, order.sequence);
+                break;
+            case SelfTradePrevention::CANCEL_AGGRESSOR:
+                order.quantity = 0;
+                break;
+            case SelfTradePrevention::CANCEL_BOTH:
+                order.quantity = 0;
+                removeResting(ladder, h);
+                break;
+            default:  // CANCEL_RESTING
+                removeResting(ladder, h);
+                break;
+        }
+    }
+
+    /**
+     * @brief Match, then rest any remainder if the type's traits allow it
+     */
+    template <Side S, typename Traits>
+    void executeAs(Order& order) {
+        match<S, Traits>(order);
+        if constexpr (Traits::rests) {
+            if (order.quantity > 0) {
+                if (order.type == OrderType::ICEBERG) splitIceberg(order);
+                restOrder(order);
+            }
+        }
+    }
+
+    /**
+     * @brief Refill an exhausted iceberg peak from its reserve and send it to the back of the level
+     */
+    void replenishIceberg(PriceLadder& ladder, OrderHandle h, uint64_t sequence) {
+        Order& order = pool[h];
+        ladder.remove(pool, h);
+        uint64_t refill = std::min(order.display_quantity, order.hidden_quantity);
+        order.quantity = refill;
+        order.hidden_quantity -= refill;
+        order.sequence = sequence;
+        ladder.pushBack(pool, order.price, h);
+    }
+
+    // Split an iceberg's open quantity into its displayed peak and hidden reserve
+    static void splitIceberg(Order& order) {
+        uint64_t total = order.quantity + order.hidden_quantity;
+        order.quantity = std::min(total, order.display_quantity);
+        order.hidden_quantity = total - order.quantity;
+    }
+
+    static bool isStop(OrderType type) {
+        return type == OrderType::STOP || type == OrderType::STOP_LIMIT;
+    }
+
+    static bool restsOnBook(OrderType type) {
+        return type == OrderType::LIMIT || type == OrderType::POST_ONLY || type == OrderType::ICEBERG;
+    }
+
+    // Types an auction can queue: priced orders that may cross, and stops (held until after the uncross)
+    static bool acceptsInAuction(OrderType type) {
+        return type == OrderType::LIMIT || type == OrderType::ICEBERG || isStop(type);
+    }
+
+    // Would a limit order at `price` trade against the current book?
+    bool crosses(Side side, Price price) const {
+        return side == Side::BUY ? (hasAsks() && price >= best_ask) : (hasBids() && price <= best_bid);
+    }
+
+    /**
+     * @brief Check, without touching the book, that `quantity` can trade at `price` or better
+     */
+    bool canFill(Side side, Price price, uint64_t quantity) const {
+        return sweepTicks(side, quantity, price, true).filled >= quantity;
+    }
+
+    /**
+     * @brief Match an order by type and rest any remainder the type allows
+     *
+     * The one runtime branch on side and type; everything below it is
+     * specialized at compile time.
+     */
+    void execute(Order& order) {
+        bool buy = order.side == Side::BUY;
+        switch (order.type) {
+            case OrderType::MARKET:
+                buy ? executeAs<Side::BUY, MarketTraits>(order) : executeAs<Side::SELL, MarketTraits>(order);
+                break;
+            case OrderType::IOC:
+            case OrderType::FOK:
+                buy ? executeAs<Side::BUY, ImmediateTraits>(order) : executeAs<Side::SELL, ImmediateTraits>(order);
+                break;
+            default:
+                buy ? executeAs<Side::BUY, LimitTraits>(order) : executeAs<Side::SELL, LimitTraits>(order);
+                break;
+        }
+    }
+
+    /**
+     * @brief Has the last trade reached this stop's trigger price?
+     */
+    bool stopTriggered(Side side, Price stop_price) const {
+        if (total_trades == 0) return false;
+        return side == Side::BUY ? last_trade_price >= stop_price : last_trade_price <= stop_price;
+    }
+
+    /**
+     * @brief Fire every stop the last trade price has reached, including ones set off by earlier fires
+     *
+     * Buy stops are tested lowest-first and sell stops highest-first, so each
+     * pass touches only the level at the front of the trigger book. Fired
+     * orders carry the timestamp of the message whose trade set them off.
+     */
+    void triggerStops(uint64_t timestamp) {
+        while (true) {
+            Price buy_trigger = buy_stops.nextAtOrAbove(buy_stops.minPrice());
+            if (buy_stops.contains(buy_trigger) && last_trade_price >= buy_trigger) {
+                fireStop(buy_stops, buy_trigger, timestamp);
+                continue;
+            }
+            Price sell_trigger = sell_stops.nextAtOrBelow(sell_stops.maxPrice());
+            if (sell_stops.contains(sell_trigger) && last_trade_price <= sell_trigger) {
+                fireStop(sell_stops, sell_trigger, timestamp);
+                continue;
+            }
+            break;
+        }
+    }
+
+    /**
+     * @brief Release the oldest stop at `stop_price` into the book as a market or limit order
+     */
+    void fireStop(PriceLadder& stops, Price stop_price, uint64_t timestamp) {
+        OrderHandle h = stops.at(stop_price).head;
+        Order order = pool[h];
+        risk_table.onRemove(order);
+        stops.remove(pool, h);
+        order_index.erase(order.order_id);
+        pool.release(h);
+
+        order.type = (order.type == OrderType::STOP) ? OrderType::MARKET : OrderType::LIMIT;
+        order.sequence = next_sequence++;
+        order.timestamp = timestamp;
+        execute(order);
+    }
+
+    /**
+     * @brief Add the unfilled remainder of a limit order to its side of the book
+     */
+    void restOrder(const Order& order) {
+        OrderHandle h = pool.allocate();
+        pool[h] = order;
+        risk_table.onRest(order);
+        if (isStop(order.type)) {
+            (order.side == Side::BUY ? buy_stops : sell_stops).pushBack(pool, order.stop_price, h);
+        } else {
+            linkResting(h);
+        }
+        order_index.insert(order.order_id, h);
+    }
+
+    /**
+     * @brief Append a pool record to the back of its price level
+     */
+    void linkResting(OrderHandle h) {
+        const Order& order = pool[h];
+        auctionDepth(order.side, order.price, static_cast<int64_t>(order.quantity + order.hidden_quantity));
+        if (order.side == Side::BUY) {
+            bids.pushBack(pool, order.price, h);
+            if (order.price > best_bid) best_bid = order.price;
+        } else {
+            asks.pushBack(pool, order.price, h);
+            if (order.price < best_ask) best_ask = order.price;
+        }
+        publishLevel(order.side, *order.level, order.price);
+    }
+
+    /**
+     * @brief Take a pool record out of its price level, keeping its index entry
+     */
+    void unlinkResting(OrderHandle h) {
+        const Order& order = pool[h];
+        if (isStop(order.type)) {
+            (order.side == Side::BUY ? buy_stops : sell_stops).remove(pool, h);
+        } else if (order.side == Side::BUY) {
+            auctionDepth(Side::BUY, order.price, -static_cast<int64_t>(order.quantity + order.hidden_quantity));
+            bids.remove(pool, h);
+            publishLevel(Side::BUY, bids.at(order.price), order.price);
+            if (order.price == best_bid) refreshBestBid();
+        } else {
+            auctionDepth(Side::SELL, order.price, -static_cast<int64_t>(order.quantity + order.hidden_quantity));
+            asks.remove(pool, h);
+            publishLevel(Side::SELL, asks.at(order.price), order.price);
+            if (order.price == best_ask) refreshBestAsk();
+        }
+    }
+
+    // Latency category of an accepted add of `type` that swept `levels` price levels
+    static LatencyOp addCategory(OrderType type, uint32_t levels) {
+        if (type == OrderType::MARKET) return LatencyOp::MARKET;
+        if (levels == 0) return LatencyOp::ADD_RESTING;
+        if (levels == 1) return LatencyOp::ADD_CROSS_1;
+        if (levels == 2) return LatencyOp::ADD_CROSS_2;
+        return levels <= 4 ? LatencyOp::ADD_CROSS_3_4 : LatencyOp::ADD_CROSS_5_PLUS;
+    }
+
+    /**
+     * @brief Timed accept(): records the add's latency by category unless it is rejected
+     */
+    uint64_t admit(uint64_t order_id, Side side, OrderType type, Price price, uint64_t quantity,
+                   const OrderOptions& options) {
+        uint64_t started = latency_stats.start();
+        if constexpr (Latency::enabled) levels_swept = 0;
+        uint64_t accepted = accept(order_id, side, type, price, quantity, options);
+        if constexpr (Latency::enabled) {
+            if (accepted) latency_stats.record(addCategory(type, levels_swept), started);
+        }
+        return accepted;
+    }
+
+    /**
+     * @brief Amend a resting order to a non-zero quantity (see modifyOrderTicks)
+     */
+    bool amend(uint64_t order_id, Price new_price, uint64_t new_quantity) {
+        if constexpr (Risk::enabled) last_reject = RiskReject::NONE;
+        uint64_t seq = next_sequence++;
+        OrderHandle* entry = order_index.find(order_id);
+        if (!entry || !bids.contains(new_price)) return false;
+
+        OrderHandle h = *entry;
+        Order& order = pool[h];
+        if (isStop(order.type)) return false;
+
+        uint64_t open_quantity = order.quantity + order.hidden_quantity;
+        if (new_price == order.price && new_quantity <= open_quantity) {
+            uint64_t cut = open_quantity - new_quantity;
+            uint64_t from_hidden = std::min(cut, order.hidden_quantity);
+            order.hidden_quantity -= from_hidden;
+            order.level->hidden_quantity -= from_hidden;
+            order.quantity -= cut - from_hidden;
+            order.level->quantity -= cut - from_hidden;
+            risk_table.onReduce(order, cut);
+            auctionDepth(order.side, order.price, -static_cast<int64_t>(cut));
+            if (cut > from_hidden) publishLevel(order.side, *order.level, order.price);
+            return true;
+        }
+
+        // A post-only order stays passive when repriced, as on entry
+        if (order.type == OrderType::POST_ONLY && phase == TradingPhase::CONTINUOUS &&
+            crosses(order.side, new_price)) {
+            return false;
+        }
+
+        // Re-check the amended order against limits net of its own current exposure
+        if constexpr (Risk::enabled) {
+            risk_table.onRemove(order);
+            last_reject = risk_table.check(order.account, order.side, order.type, new_price, new_quantity, new_price,
+                                           total_trades > 0, last_trade_price);
+            if (last_reject != RiskReject::NONE) {
+                risk_table.onRest(order);
+                return false;
+            }
+        }
+
+        unlinkResting(h);
+        order.price = new_price;
+        order.quantity = new_quantity;
+        order.hidden_quantity = 0;
+        order.sequence = seq;
+        order.timestamp = clock.now();
+
+        // In an auction the repriced order re-queues without matching
+        uint64_t trades_before = total_trades;
+        if (phase == TradingPhase::CONTINUOUS) {
+            if (order.side == Side::BUY) {
+                match<Side::BUY, LimitTraits>(order);
+            } else {
+                match<Side::SELL, LimitTraits>(order);
+            }
+        }
+
+        if (order.quantity > 0) {
+            if (order.type == OrderType::ICEBERG) splitIceberg(order);
+            linkResting(h);
+            risk_table.onRest(order);
+        } else {
+            order_index.erase(order_id);
+            pool.release(h);
+        }
+
+        if (total_trades != trades_before) triggerStops(order.timestamp);
+        return true;
+    }
+
+    /**
+     * @brief Remove a resting order or untriggered stop; false if the ID is not resting
+     */
+    bool cancelResting(uint64_t order_id) {
+        next_sequence++;
+        OrderHandle* entry = order_index.find(order_id);
+        if (!entry) return false;
+
+        withdraw(*entry);
+        return true;
+    }
+
+    // Take a resting order or untriggered stop off the book whole, publishing its level
+    void withdraw(OrderHandle h) {
+        risk_table.onRemove(pool[h]);
+        unlinkResting(h);
+        order_index.erase(pool[h].order_id);
+        pool.release(h);
+    }
+
+    /**
+     * @brief Validate, match and rest a new order under `order_id`
+     * @return `order_id`, or 0 if rejected (see addOrderTicks)
+     */
+    uint64_t accept(uint64_t order_id, Side side, OrderType type, Price price, uint64_t quantity,
+                   const OrderOptions& options) {
+        bool has_limit = type != OrderType::MARKET && type != OrderType::STOP;
+        if constexpr (Risk::enabled) last_reject = RiskReject::NONE;
+        // Side and type may come straight off the wire; anything else would rest unchecked
+        if (side > Side::SELL || type > OrderType::STOP_LIMIT) return 0;
+        if (quantity == 0) return 0;
+        if (has_limit && !bids.contains(price)) return 0;
+        if (isStop(type) && !bids.contains(options.stop_price)) return 0;
+        if ((restsOnBook(type) || isStop(type)) && pool.full()) return 0;
+        if (phase == TradingPhase::AUCTION && !acceptsInAuction(type)) return 0;
+        if constexpr (Risk::enabled) {
+            // Market orders are valued at the opposite touch, or the last trade if that side is empty
+            Price value = has_limit ? price : type == OrderType::STOP ? options.stop_price
+                        : side == Side::BUY ? (hasAsks() ? best_ask : last_trade_price)
+                                            : (hasBids() ? best_bid : last_trade_price);
+            last_reject = risk_table.check(options.account, side, type, price, quantity, value,
+                                           total_trades > 0, last_trade_price);
+            if (last_reject != RiskReject::NONE) return 0;
+        }
+        if (type == OrderType::POST_ONLY && crosses(side, price)) return 0;
+        if (type == OrderType::FOK && !canFill(side, price, quantity)) return 0;
+        if (type == OrderType::ICEBERG && options.display_quantity == 0) return 0;
+
+        // The incoming order lives on the stack; only a resting remainder takes a pool record
+        Order order(order_id, side, type, price, quantity, next_sequence++, clock.now());
+        order.stop_price = options.stop_price;
+        order.display_quantity = options.display_quantity;
+        order.account = options.account;
+        total_orders_processed++;
+
+        if (isStop(type)) {
+            if (phase == TradingPhase::AUCTION || !stopTriggered(side, order.stop_price)) {
+                restOrder(order);
+                return order_id;
+            }
+            order.type = (type == OrderType::STOP) ? OrderType::MARKET : OrderType::LIMIT;
+        }
+
+        // Auction orders queue at their limit, crossed or not, until uncross()
+        if (phase == TradingPhase::AUCTION) {
+            if (type == OrderType::ICEBERG) splitIceberg(order);
+            restOrder(order);
+            return order_id;
+        }
+
+        uint64_t trades_before = total_trades;
+        execute(order);
+        if (total_trades != trades_before) triggerStops(order.timestamp);
+
+        return order_id;
+    }
+
+public:
+    /**
+     * @param max_resting_orders Capacity of the order pool and ID index, fixed for the book's lifetime
+     * @param sink_args Forwarded to the TradeSink constructor
+     */
+    template <typename... SinkArgs>
+    explicit BasicOrderBook(const Instrument& instrument_, size_t max_resting_orders = 1 << 20,
+                            SinkArgs&&... sink_args)
+        : instrument(instrument_),
+          bids(instrument_.toTicks(instrument_.reference_price) - instrument_.ladder_ticks,
+               instrument_.toTicks(instrument_.reference_price) + instrument_.ladder_ticks),
+          asks(bids.minPrice(), bids.maxPrice()),
+          buy_stops(bids.minPrice(), bids.maxPrice()),
+          sell_stops(bids.minPrice(), bids.maxPrice()),
+          best_bid(bids.minPrice() - 1),
+          best_ask(asks.maxPrice() + 1),
+          pool(max_resting_orders),
+          order_index(max_resting_orders),
+          trade_sink(std::forward<SinkArgs>(sink_args)...),
+          depth_sink(instrument_),
+          auction_curves(bids.minPrice(), bids.maxPrice()) {}
+
+    // Levels and pool records point at each other; the book stays where it was built
+    BasicOrderBook(const BasicOrderBook&) = delete;
+    BasicOrderBook& operator=(const BasicOrderBook&) = delete;
+
+    const Instrument& getInstrument() const { return instrument; }
+
+    TradeSink& tradeSink() { return trade_sink; }
+    const TradeSink& tradeSink() const { return trade_sink; }
+
+    DepthSink& depthSink() { return depth_sink; }
+    const DepthSink& depthSink() const { return depth_sink; }
+
+    Latency& latencyStats() { return latency_stats; }
+    const Latency& latencyStats() const { return latency_stats; }
+
+    Risk& risk() { return risk_table; }
+    const Risk& risk() const { return risk_table; }
+
+    // Why the last rejected add or modify failed a risk limit; NONE if it failed for another reason
+    RiskReject lastRiskReject() const { return last_reject; }
+
+    /**
+     * @brief Choose what matching does when an order meets a resting order of its own (non-zero) account
+     *
+     * Takes effect from the next message. FOK fill checks do not anticipate
+     * prevention, so a FOK can pass its check and still be cut short by it.
+     */
+    void setSelfTradePrevention(SelfTradePrevention mode) { stp_mode = mode; }
+    SelfTradePrevention selfTradePrevention() const { return stp_mode; }
+
+    // Allocation policy parameters (pro-rata minimum allocation, hybrid top-order cap)
+    Allocation& allocation() { return allocation_policy; }
+    const Allocation& allocation() const { return allocation_policy; }
+
+    /**
+     * @brief Open a call auction (opening or closing): orders queue without matching until uncross()
+     *
+     * Resting orders stay and take part. During the auction limit and iceberg
+     * orders rest at their price even if they cross; market, IOC, FOK and
+     * post-only orders are rejected, and stops are held without triggering.
+     * Cancels and modifies work as usual, a repriced order re-queuing rather
+     * than matching. Snapshots are refused until the uncross.
+     */
+    void startAuction() {
+        if (phase == TradingPhase::AUCTION) return;
+        auction_curves.clear();
+        for (Price p = best_bid; p >= bids.minPrice(); p = bids.nextAtOrBelow(p - 1)) {
+            auction_curves.update(Side::BUY, p, static_cast<int64_t>(bids.at(p).quantity + bids.at(p).hidden_quantity));
+        }
+        for (Price p = best_ask; p <= asks.maxPrice(); p = asks.nextAtOrAbove(p + 1)) {
+            auction_curves.update(Side::SELL, p, static_cast<int64_t>(asks.at(p).quantity + asks.at(p).hidden_quantity));
+        }
+        phase = TradingPhase::AUCTION;
+    }
+
+    TradingPhase tradingPhase() const { return phase; }
+
+    /**
+     * @brief Price and volume the auction would uncross at now; O(log levels), cheap enough to publish per message
+     *
+     * Hidden iceberg quantity counts. Ties in volume and imbalance go to the
+     * price nearest the last trade (the instrument's reference price before
+     * the first trade). Volume 0 outside an auction or while nothing crosses.
+     */
+    AuctionQuote indicativeAuction() const {
+        if (phase != TradingPhase::AUCTION) return {};
+        Price reference = total_trades > 0 ? last_trade_price : instrument.toTicks(instrument.reference_price);
+        return auction_curves.quote(bids, asks, reference);
+    }
+
+    /**
+     * @brief End the auction: execute the indicative volume at one price and return to continuous trading
+     *
+     * One pass down the bids from the best and up the asks from the best,
+     * pairing orders in price-time priority; every fill prints at the
+     * uncrossing price. Self-trade prevention is not applied, since it would
+     * change the volume the curves determined. Stops the fills trigger are
+     * then released into the continuous book.
+     *
+     * @return The auction's price, volume and imbalance (volume 0 if nothing traded)
+     */
+    AuctionQuote uncross() {
+        AuctionQuote result = indicativeAuction();
+        phase = TradingPhase::CONTINUOUS;
+        if (result.volume == 0) return result;
+
+        uint64_t sequence = next_sequence++;
+        uint64_t timestamp = clock.now();
+        bool bid_partial = false;  // The last fill left its bid level non-empty
+        bool ask_partial = false;
+        uint64_t remaining = result.volume;
+        // The curves and the ladders should agree on the volume; the side
+        // checks keep a disagreement from reading an empty level
+        while (remaining > 0 && hasBids() && hasAsks()) {
+            PriceLevel& bid_level = bids.at(best_bid);
+            PriceLevel& ask_level = asks.at(best_ask);
+            OrderHandle buy_handle = bid_level.head;
+            OrderHandle sell_handle = ask_level.head;
+            Order& buy = pool[buy_handle];
+            Order& sell = pool[sell_handle];
+
+            uint64_t trade_qty = std::min({remaining, buy.quantity, sell.quantity});
+            trade_sink.onTrade(Trade(buy.order_id, sell.order_id, result.price, trade_qty, timestamp));
+            total_trades++;
+            if constexpr (Risk::enabled) {
+                risk_table.onRestingFill(buy, result.price, trade_qty);
+                risk_table.onRestingFill(sell, result.price, trade_qty);
+            }
+            remaining -= trade_qty;
+            buy.quantity -= trade_qty;
+            bid_level.quantity -= trade_qty;
+            sell.quantity -= trade_qty;
+            ask_level.quantity -= trade_qty;
+
+            if (buy.quantity == 0) exhaust(bids, buy_handle, sequence);
+            if (sell.quantity == 0) exhaust(asks, sell_handle, sequence);
+            bid_partial = !bid_level.empty();
+            ask_partial = !ask_level.empty();
+            if (!bid_partial) {
+                publishLevel(Side::BUY, bid_level, best_bid);
+                refreshBestBid();
+            }
+            if (!ask_partial) {
+                publishLevel(Side::SELL, ask_level, best_ask);
+                refreshBestAsk();
+            }
+        }
+        // The levels the uncross stopped in were partly filled
+        if (bid_partial) publishLevel(Side::BUY, bids.at(best_bid), best_bid);
+        if (ask_partial) publishLevel(Side::SELL, asks.at(best_ask), best_ask);
+        result.volume -= remaining;
+        if (result.volume == 0) return result;
+
+        last_trade_price = result.price;
+        triggerStops(timestamp);
+        return result;
+    }
+
+    /**
+     * @brief Add a new order to the book, prices given in ticks
+     * @return Order ID, or 0 if the order is rejected: an unknown side or type,
+     *         zero quantity, a limit or stop price outside the ladder, a book at its resting-order capacity,
+     *         a POST_ONLY that would cross, a FOK that cannot fill completely,
+     *         an ICEBERG without a display quantity, or a risk limit (see lastRiskReject)
+     */
+    uint64_t addOrderTicks(Side side, OrderType type, Price price, uint64_t quantity,
+                           const OrderOptions& options = {}) {
+        uint64_t order_id = admit(next_order_id, side, type, price, quantity, options);
+        if (order_id) next_order_id++;
+        return order_id;
+    }
+
+    /**
+     * @brief Add a new order under an ID assigned by the caller (an engine or a feed)
+     *
+     * A book should take its IDs either from addOrderTicks or from this call,
+     * not both, since the book's own counter does not skip caller IDs.
+     *
+     * @return `order_id`, or 0 if rejected (see addOrderTicks), if `order_id`
+     *         is 0, or if an order with that ID is already resting
+     */
+    uint64_t addOrderTicksWithId(uint64_t order_id, Side side, OrderType type, Price price,
+                                 uint64_t quantity, const OrderOptions& options = {}) {
+        if (order_id == 0 || order_index.find(order_id)) return 0;
+        return admit(order_id, side, type, price, quantity, options);
+    }
+
+    /**
+     * @brief Add a new LIMIT, MARKET, IOC, FOK or POST_ONLY order to the book
+     * @return Order ID, or 0 if rejected (see addOrderTicks)
+     */
+    uint64_t addOrder(Side side, OrderType type, double price, uint64_t quantity) {
+        return addOrderTicks(side, type, instrument.toTicks(price), quantity);
+    }
+
+    /**
+     * @brief Add an iceberg order showing at most `display_quantity` at a time
+     */
+    uint64_t addIcebergOrder(Side side, double price, uint64_t quantity, uint64_t display_quantity) {
+        OrderOptions options;
+        options.display_quantity = display_quantity;
+        return addOrderTicks(side, OrderType::ICEBERG, instrument.toTicks(price), quantity, options);
+    }
+
+    /**
+     * @brief Add a stop order that becomes a market order once a trade prints at `stop_price` or through it
+     */
+    uint64_t addStopOrder(Side side, double stop_price, uint64_t quantity) {
+        OrderOptions options;
+        options.stop_price = instrument.toTicks(stop_price);
+        return addOrderTicks(side, OrderType::STOP, 0, quantity, options);
+    }
+
+    /**
+     * @brief Add a stop order that becomes a limit order at `limit_price` once triggered
+     */
+    uint64_t addStopLimitOrder(Side side, double stop_price, double limit_price, uint64_t quantity) {
+        OrderOptions options;
+        options.stop_price = instrument.toTicks(stop_price);
+        return addOrderTicks(side, OrderType::STOP_LIMIT, instrument.toTicks(limit_price), quantity, options);
+    }
+
+    /**
+     * @brief Cancel an existing order (resting or untriggered stop)
+     */
+    bool cancelOrder(uint64_t order_id) {
+        uint64_t started = latency_stats.start();
+        bool cancelled = cancelResting(order_id);
+        latency_stats.record(LatencyOp::CANCEL, started);
+        return cancelled;
+    }
+
+    /**
+     * @brief Take `quantity` off a resting order without moving it in its queue
+     *
+     * For feed replay, where executions and partial cancels arrive as
+     * reductions of a known order. Displayed quantity goes first; an iceberg
+     * whose peak runs out is replenished. The order is removed once nothing
+     * is left open; that removal is not recorded as a CANCEL latency.
+     *
+     * @return false if the order is not resting
+     */
+    bool reduceOrder(uint64_t order_id, uint64_t quantity) {
+        OrderHandle* entry = order_index.find(order_id);
+        if (!entry) return false;
+
+        OrderHandle h = *entry;
+        Order& order = pool[h];
+        uint64_t seq = next_sequence++;
+        // Fully executed or cancelled; not timed as a cancel, since feed executions end here too
+        if (quantity >= order.quantity + order.hidden_quantity) {
+            withdraw(h);
+            return true;
+        }
+
+        risk_table.onReduce(order, quantity);
+        uint64_t from_display = std::min(quantity, order.quantity);
+        order.quantity -= from_display;
+        order.level->quantity -= from_display;
+        order.hidden_quantity -= quantity - from_display;
+        order.level->hidden_quantity -= quantity - from_display;
+        if (isStop(order.type)) return true;
+        auctionDepth(order.side, order.price, -static_cast<int64_t>(quantity));
+        if (order.quantity == 0) replenishIceberg(order.side == Side::BUY ? bids : asks, h, seq);
+        publishLevel(order.side, *order.level, order.price);
+        return true;
+    }
+
+    /**
+     * @brief Amend a resting order's price and/or remaining quantity, price given in ticks
+     *
+     * Reducing quantity at the same price updates the order in place and keeps
+     * its queue position. A price change or quantity increase re-queues it in
+     * the same call: it loses priority, may trade if the new price crosses, and
+     * keeps its order ID. A new quantity of 0 cancels.
+     *
+     * For an iceberg the quantity is the total open amount; a reduction comes
+     * out of the hidden reserve first.
+     *
+     * @return false if the order is not resting (untriggered stops included),
+     *         the new price is off the ladder, or a POST_ONLY order's new price
+     *         would cross (the order is left as it was)
+     */
+    bool modifyOrderTicks(uint64_t order_id, Price new_price, uint64_t new_quantity) {
+        if (new_quantity == 0) return cancelOrder(order_id);
+
+        uint64_t started = latency_stats.start();
+        bool amended = amend(order_id, new_price, new_quantity);
+        latency_stats.record(LatencyOp::MODIFY, started);
+        return amended;
+    }
+
+    /**
+     * @brief Amend a resting order's price and/or remaining quantity
+     */
+    bool modifyOrder(uint64_t order_id, double new_price, uint64_t new_quantity) {
+        return modifyOrderTicks(order_id, instrument.toTicks(new_price), new_quantity);
+    }
+
+    /**
+     * @brief Get best bid price
+     */
+    double getBestBid() const {
+        return hasBids() ? instrument.toPrice(best_bid) : 0.0;
+    }
+
+    /**
+     * @brief Get best ask price
+     */
+    double getBestAsk() const {
+        return hasAsks() ? instrument.toPrice(best_ask) : 0.0;
+    }
+
+    // Touch and last trade in ticks, for callers working in ticks; 0 for an
+    // empty side, and for the last trade before the first one
+    Price getBestBidTicks() const { return hasBids() ? best_bid : 0; }
+    Price getBestAskTicks() const { return hasAsks() ? best_ask : 0; }
+    Price getLastTradeTicks() const { return total_trades > 0 ? last_trade_price : 0; }
+
+    /**
+     * @brief Get mid price
+     */
+    double getMidPrice() const {
+        if (!hasBids() || !hasAsks()) return 0.0;
+        return instrument.toPrice(best_bid + best_ask) / 2.0;
+    }
+
+    /**
+     * @brief Get spread
+     */
+    double getSpread() const {
+        if (!hasBids() || !hasAsks()) return 0.0;
+        return instrument.toPrice(best_ask - best_bid);
+    }
+
+    /**
+     * @brief Print order book state
+     */
+    void printOrderBook(int depth = 5) const {
+        std::cout << "\n=== Order Book ===" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+
+        // Ask side (sell orders), collected best-first then printed highest-first
+        std::cout << "\n--- ASKS (Sell) ---" << std::endl;
+        std::cout << std::setw(12) << "Price" << std::setw(15) << "Quantity" << std::setw(15) << "Orders" << std::endl;
+        std::cout << std::string(42, '-') << std::endl;
+
+        std::vector<Price> ask_levels;
+        for (Price p = best_ask; p <= asks.maxPrice() && (int)ask_levels.size() < depth;
+             p = asks.nextAtOrAbove(p + 1)) {
+            ask_levels.push_back(p);
+        }
+        for (auto it = ask_levels.rbegin(); it != ask_levels.rend(); ++it) {
+            const PriceLevel& level = asks.at(*it);
+            std::cout << std::setw(12) << instrument.toPrice(*it)
+                      << std::setw(15) << level.quantity
+                      << std::setw(15) << level.order_count << std::endl;
+        }
+
+        // Spread
+        std::cout << "\n" << std::string(42, '=') << std::endl;
+        std::cout << "Spread: $" << getSpread() << " | Mid: $" << getMidPrice() << std::endl;
+        std::cout << std::string(42, '=') << "\n" << std::endl;
+
+        // Bid side (buy orders), highest first
+        std::cout << "--- BIDS (Buy) ---" << std::endl;
+        std::cout << std::setw(12) << "Price" << std::setw(15) << "Quantity" << std::setw(15) << "Orders" << std::endl;
+        std::cout << std::string(42, '-') << std::endl;
+
+        int count = 0;
+        for (Price p = best_bid; p >= bids.minPrice() && count < depth; p = bids.nextAtOrBelow(p - 1)) {
+            const PriceLevel& level = bids.at(p);
+            std::cout << std::setw(12) << instrument.toPrice(p)
+                      << std::setw(15) << level.quantity
+                      << std::setw(15) << level.order_count << std::endl;
+            count++;
+        }
+        std::cout << std::endl;
+    }
+
+    /**
+     * @brief Print the newest trades (requires a sink with forEachRecent, e.g. TradeRing)
+     *
+     * With the default OVERWRITE ring these are always the last `n` fills.
+     */
+    void printRecentTrades(int n = 10) const {
+        std::cout << "=== Recent Trades ===" << std::endl;
+        std::cout << std::setw(12) << "Buy ID"
+                  << std::setw(12) << "Sell ID"
+                  << std::setw(12) << "Price"
+                  << std::setw(12) << "Quantity" << std::endl;
+        std::cout << std::string(48, '-') << std::endl;
+
+        trade_sink.forEachRecent(n, [this](const Trade& trade) {
+            std::cout << std::setw(12) << trade.buy_order_id
+                      << std::setw(12) << trade.sell_order_id
+                      << std::setw(12) << std::fixed << std::setprecision(2) << instrument.toPrice(trade.price)
+                      << std::setw(12) << trade.quantity << std::endl;
+        });
+        std::cout << std::endl;
+    }
+
+    /**
+     * @brief Print statistics, with latency percentiles per operation when the book records them
+     */
+    void printStats() const {
+        std::cout << "=== Order Book Statistics ===" << std::endl;
+        std::cout << "Total orders processed: " << total_orders_processed << std::endl;
+        std::cout << "Total trades executed: " << total_trades << std::endl;
+        if (stp_mode != SelfTradePrevention::NONE) {
+            std::cout << "Self-trades prevented: " << self_trades_prevented << std::endl;
+        }
+        std::cout << "Active resting orders: " << order_index.size() << std::endl;
+        if (phase == TradingPhase::AUCTION) {
+            AuctionQuote quote = indicativeAuction();
+            std::cout << "In auction, indicative: " << quote.volume << " @ $" << std::fixed << std::setprecision(2)
+                      << instrument.toPrice(quote.price) << " (imbalance " << quote.imbalance << ")" << std::endl;
+        }
+        std::cout << "Best bid: $" << std::fixed << std::setprecision(2) << getBestBid() << std::endl;
+        std::cout << "Best ask: $" << getBestAsk() << std::endl;
+        std::cout << "Spread: $" << getSpread() << std::endl;
+        if constexpr (Latency::enabled) latency_stats.print(std::cout);
+        std::cout << std::endl;
+    }
+
+    /**
+     * @brief Quantity resting on `side` within `ticks` of that side's best price
+     *
+     * O(non-empty levels in range): reads each level's running totals, never its orders.
+     */
+    uint64_t depthWithin(Side side, Price ticks, bool include_hidden = false) const {
+        const PriceLadder& book = (side == Side::BUY) ? bids : asks;
+        uint64_t total = 0;
+        if (side == Side::BUY) {
+            for (Price p = best_bid; p >= bids.minPrice() && p >= best_bid - ticks; p = bids.nextAtOrBelow(p - 1)) {
+                total += book.at(p).quantity + (include_hidden ? book.at(p).hidden_quantity : 0);
+            }
+        } else {
+            for (Price p = best_ask; p <= asks.maxPrice() && p <= best_ask + ticks; p = asks.nextAtOrAbove(p + 1)) {
+                total += book.at(p).quantity + (include_hidden ? book.at(p).hidden_quantity : 0);
+            }
+        }
+        return total;
+    }
+
+    // Outcome of walking an aggressor's quantity through the opposite side
+    struct SweepResult {
+        uint64_t filled = 0;     // Quantity available up to the limit, at most the requested amount
+        int64_t notional = 0;    // Sum of price * quantity over the fills, in ticks
+        Price worst_price = 0;   // Price of the last level reached, in ticks (0 if nothing fills)
+    };
+
+    /**
+     * @brief What an aggressor of `side` for `quantity` would trade against, no further than `limit`
+     *
+     * Walks level totals, not orders; iceberg reserves count when
+     * `include_hidden`, since a sweep replenishes them at the same price.
+     */
+    SweepResult sweepTicks(Side side, uint64_t quantity, Price limit, bool include_hidden = true) const {
+        const PriceLadder& book = (side == Side::BUY) ? asks : bids;
+        SweepResult result;
+        Price p = (side == Side::BUY) ? best_ask : best_bid;
+        while (result.filled < quantity && book.contains(p) && (side == Side::BUY ? p <= limit : p >= limit)) {
+            const PriceLevel& level = book.at(p);
+            uint64_t take = std::min(quantity - result.filled,
+                                     level.quantity + (include_hidden ? level.hidden_quantity : 0));
+            result.filled += take;
+            result.notional += p * static_cast<int64_t>(take);
+            result.worst_price = p;
+            p = (side == Side::BUY) ? book.nextAtOrAbove(p + 1) : book.nextAtOrBelow(p - 1);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Average price a market order of `side` for `quantity` would pay now, or 0 if the side is empty
+     *
+     * @param filled Receives the quantity the opposite side can absorb, if not null
+     */
+    double sweepCost(Side side, uint64_t quantity, uint64_t* filled = nullptr) const {
+        Price limit = (side == Side::BUY) ? asks.maxPrice() : bids.minPrice();
+        SweepResult result = sweepTicks(side, quantity, limit);
+        if (filled) *filled = result.filled;
+        if (result.filled == 0) return 0.0;
+        return instrument.toPrice(result.notional) / static_cast<double>(result.filled);
+    }
+
+    /**
+     * @brief Write a point-in-time image of the book to `path`
+     *
+     * Call from the matching thread between messages (a quiescent slice), or
+     * use forkSnapshot() to let a child process write it. The image is written
+     * to `path` + ".tmp" and renamed into place, so a crash never leaves a
+     * partial snapshot under `path`. `journal_sequence` is stored so that a
+     * restart replays only journal records after it.
+     *
+     * @return false on an I/O error
+     */
+    bool saveSnapshot(const std::string& path, uint64_t journal_sequence = 0) const {
+        std::string tmp = path + ".tmp";
+        return writeSnapshot(tmp.c_str(), path.c_str(), journal_sequence);
+    }
+
+    /**
+     * @brief Write the snapshot from a forked child while matching continues (copy-on-write)
+     *
+     * The child sees the book exactly as of the call and writes it with raw
+     * system calls only. The parent pays a page copy the first time it writes
+     * to each page while the child runs. Reap the child with waitSnapshot().
+     *
+     * @return The child's pid, or -1 if fork failed
+     */
+    int forkSnapshot(const std::string& path, uint64_t journal_sequence = 0) const {
+        std::string tmp = path + ".tmp";
+        pid_t pid = ::fork();
+        if (pid == 0) ::_exit(writeSnapshot(tmp.c_str(), path.c_str(), journal_sequence) ? 0 : 1);
+        return static_cast<int>(pid);
+    }
+
+    // Wait for a forkSnapshot() child; true if it wrote the snapshot
+    static bool waitSnapshot(int pid) {
+        int status = 0;
+        if (pid < 0 || ::waitpid(pid, &status, 0) != pid) return false;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    /**
+     * @brief Replace the book's state with a snapshot image
+     *
+     * The file is mapped and its sections copied into the ladders and the
+     * pool. Handles are position-independent, so the only fix-ups are each
+     * live record's level pointer and its index entry. The copy is deliberate:
+     * the book owns its preallocated slabs and hands out pointers into them,
+     * and adopting a private mapping in their place would move a
+     * copy-on-write page fault onto the matching thread's first write to
+     * every page. Load time is a memory-bandwidth copy instead.
+     *
+     * Whatever the book held before is retracted first. The depth sink gets
+     * every old level as emptied, then every restored level. A RiskTable
+     * loses the old orders' open exposure and gains the restored orders'
+     * (account positions are not part of the image). The book returns to
+     * continuous trading, since a snapshot is never taken during an auction.
+     *
+     * @param journal_sequence Receives the image's journal sequence, if not null
+     * @return false if the file is unreadable or was taken from a book with a
+     *         different ladder, pool capacity or record layout; the book is then unchanged
+     */
+    bool loadSnapshot(const std::string& path, uint64_t* journal_sequence = nullptr) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) return false;
+
+        const char* image = static_cast<const char*>(map);
+        SnapshotHeader header;
+        std::memcpy(&header, image, sizeof(header));
+        size_t expected = sizeof(SnapshotHeader) + header.pool_high_water * sizeof(Order);
+        forEachLadder([&](const PriceLadder& ladder) {
+            ladder.forEachSection([&](const void*, size_t n) { expected += n; });
+        });
+        if (std::memcmp(header.magic, "OBSNAP2", 8) != 0 || header.order_size != sizeof(Order) ||
+            header.level_size != sizeof(PriceLevel) || header.min_price != bids.minPrice() ||
+            header.max_price != bids.maxPrice() || header.pool_capacity != pool.capacity() ||
+            header.pool_high_water > pool.capacity() || size != expected) {
+            ::munmap(map, size);
+            return false;
+        }
+
+        for (Price p = best_bid; p >= bids.minPrice(); p = bids.nextAtOrBelow(p - 1)) {
+            depth_sink.onLevelUpdate(Side::BUY, p, 0, 0);
+        }
+        for (Price p = best_ask; p <= asks.maxPrice(); p = asks.nextAtOrAbove(p + 1)) {
+            depth_sink.onLevelUpdate(Side::SELL, p, 0, 0);
+        }
+        if constexpr (Risk::enabled) {
+            for (OrderHandle h = 0; h < pool.highWater(); ++h) {
+                const Order& order = pool[h];
+                if (order.level && order.account < risk_table.size()) risk_table.onRemove(order);
+            }
+        }
+        phase = TradingPhase::CONTINUOUS;
+        auction_curves.clear();
+
+        size_t pos = sizeof(SnapshotHeader);
+        forEachLadder([&](PriceLadder& ladder) {
+            ladder.forEachSection([&](void* dst, size_t n) {
+                std::memcpy(dst, image + pos, n);
+                pos += n;
+            });
+        });
+        pool.restore(reinterpret_cast<const Order*>(image + pos), header.pool_high_water,
+                     header.free_head, header.pool_in_use);
+        ::munmap(map, size);
+
+        // Fix-ups: re-point every live record at its level and index it
+        order_index.clear();
+        for (OrderHandle h = 0; h < header.pool_high_water; ++h) {
+            Order& order = pool[h];
+            if (!order.level) continue;
+            if (isStop(order.type)) {
+                order.level = &(order.side == Side::BUY ? buy_stops : sell_stops).at(order.stop_price);
+            } else {
+                order.level = &(order.side == Side::BUY ? bids : asks).at(order.price);
+            }
+            order_index.insert(order.order_id, h);
+            if constexpr (Risk::enabled) {
+                if (order.account < risk_table.size()) risk_table.onRest(order);
+            }
+        }
+
+        next_order_id = header.next_order_id;
+        next_sequence = header.next_sequence;
+        total_orders_processed = header.total_orders_processed;
+        total_trades = header.total_trades;
+        last_trade_price = header.last_trade_price;
+        best_bid = header.best_bid;
+        best_ask = header.best_ask;
+        if (journal_sequence) *journal_sequence = header.journal_sequence;
+
+        for (Price p = best_bid; p >= bids.minPrice(); p = bids.nextAtOrBelow(p - 1)) {
+            publishLevel(Side::BUY, bids.at(p), p);
+        }
+        for (Price p = best_ask; p <= asks.maxPrice(); p = asks.nextAtOrAbove(p + 1)) {
+            publishLevel(Side::SELL, asks.at(p), p);
+        }
+        return true;
+    }
+
+    uint64_t getTotalTrades() const { return total_trades; }
+    uint64_t getSelfTradesPrevented() const { return self_trades_prevented; }
+    uint64_t getTotalOrders() const { return total_orders_processed; }
+    size_t getRestingOrders() const { return order_index.size(); }
+
+    /**
+     * @brief Hint that `order_id` is about to be looked up, for callers that see their flow ahead (replay)
+     *
+     * Issue it once with `record` false to load the index slot, then again
+     * with `record` true, once that slot has had time to arrive, to load the
+     * order record itself.
+     */
+    void prefetchOrder(uint64_t order_id, bool record) const {
+        if (!record) {
+            order_index.prefetch(order_id);
+        } else if (const OrderHandle* entry = order_index.find(order_id)) {
+            __builtin_prefetch(&pool[*entry]);
+        }
+    }
+
+    /**
+     * @brief A resting order (or untriggered stop) by ID, or nullptr
+     *
+     * The pointer is valid until the book is next modified.
+     */
+    const Order* findOrder(uint64_t order_id) const {
+        const OrderHandle* entry = order_index.find(order_id);
+        return entry ? &pool[*entry] : nullptr;
+    }
+};
+
+using OrderBook = BasicOrderBook<>;
+
+// OrderBook with per-operation latency histograms
+using TimedOrderBook = BasicOrderBook<TscClock, TradeRing, DenseIdHash, NullDepthSink, LatencyRecorder>;
+
+// OrderBook with per-account pre-trade risk checks
+using RiskOrderBook = BasicOrderBook<TscClock, TradeRing, DenseIdHash, NullDepthSink, NullLatency, RiskTable>;
+
+// OrderBooks allocating each level pro-rata, and top order then pro-rata
+using ProRataOrderBook =
+    BasicOrderBook<TscClock, TradeRing, DenseIdHash, NullDepthSink, NullLatency, NullRisk, ProRataAllocation>;
+using HybridOrderBook =
+    BasicOrderBook<TscClock, TradeRing, DenseIdHash, NullDepthSink, NullLatency, NullRisk, HybridAllocation>;
+
+// Fixed-layout structs are read in place from receive buffers, so the wire
+// byte order must be the host's
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "wire messages are little-endian");
+
+constexpr uint8_t kWireVersion = 1;
+
+enum class MsgType : uint8_t {
+    NEW_ORDER = 1,
+    CANCEL = 2,
+    MODIFY = 3,
+    FILL = 4,         // Outbound: one trade
+    BOOK_UPDATE = 5,  // Outbound: new aggregate state of one price level
+    ORDER_ACK = 6     // Outbound: result of a new, cancel or modify
+};
+
+enum class AckStatus : uint8_t {
+    ACCEPTED,
+    REJECTED,
+    CANCELLED,
+    MODIFIED,
+    UNKNOWN_ORDER,  // Cancel or modify for an order that is not resting
+    RISK_REJECTED   // New or modify refused by a pre-trade risk limit
+};
+
+#pragma pack(push, 1)
+
+// Leads every message; `length` covers the whole message, header included
+struct MsgHeader {
+    uint16_t length;
+    MsgType type;
+    uint8_t version;
+};
+
+struct NewOrderMsg {
+    MsgHeader header;
+    uint32_t symbol;
+    uint64_t order_id;  // 0 lets the receiver assign one
+    Price price;        // Ticks; ignored for MARKET and STOP
+    uint64_t quantity;
+    Price stop_price;   // STOP, STOP_LIMIT
+    uint64_t display_quantity;  // ICEBERG
+    uint8_t side;       // Side
+    uint8_t type;       // OrderType
+    uint8_t reserved[2];
+    uint32_t account;
+};
+
+struct CancelMsg {
+    MsgHeader header;
+    uint32_t symbol;
+    uint64_t order_id;
+};
+
+struct ModifyMsg {
+    MsgHeader header;
+    uint32_t symbol;
+    uint64_t order_id;
+    Price price;
+    uint64_t quantity;
+};
+
+struct FillMsg {
+    MsgHeader header;
+    uint32_t symbol;
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    Price price;
+    uint64_t quantity;
+    uint64_t timestamp;
+};
+
+struct BookUpdateMsg {
+    MsgHeader header;
+    uint32_t symbol;
+    Price price;
+    uint64_t quantity;     // Total displayed quantity at the level; 0 once it empties
+    uint32_t order_count;
+    uint8_t side;          // Side
+    uint8_t reserved[3];
+};
+
+struct OrderAckMsg {
+    MsgHeader header;
+    uint32_t symbol;
+    uint64_t order_id;
+    uint8_t status;        // AckStatus
+    uint8_t reserved[7];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(MsgHeader) == 4, "wire layout");
+static_assert(sizeof(NewOrderMsg) == 56, "wire layout");
+static_assert(sizeof(CancelMsg) == 16, "wire layout");
+static_assert(sizeof(ModifyMsg) == 32, "wire layout");
+static_assert(sizeof(FillMsg) == 48, "wire layout");
+static_assert(sizeof(BookUpdateMsg) == 32, "wire layout");
+static_assert(sizeof(OrderAckMsg) == 24, "wire layout");
+
+/**
+ * @struct MsgHandler
+ * @brief No-op callbacks for every message type
+ *
+ * decodeMessages() is a template over the handler, so a handler derives from
+ * this, redeclares only the callbacks it cares about, and gets static dispatch.
+ */
+struct MsgHandler {
+    void onNewOrder(const NewOrderMsg&) {}
+    void onCancel(const CancelMsg&) {}
+    void onModify(const ModifyMsg&) {}
+    void onFill(const FillMsg&) {}
+    void onBookUpdate(const BookUpdateMsg&) {}
+    void onOrderAck(const OrderAckMsg&) {}
+};
+
+/**
+ * @brief Dispatch every complete message in `data` to `handler`, in place
+ *
+ * Handlers receive references into the buffer itself; nothing is copied or
+ * allocated. Messages of unknown type, or shorter than their type's layout,
+ * are skipped by their length.
+ *
+ * @return Bytes consumed; a trailing partial message is left for the next call
+ */
+template <typename Handler>
+size_t decodeMessages(const char* data, size_t size, Handler& handler) {
+    size_t pos = 0;
+    while (size - pos >= sizeof(MsgHeader)) {
+        const MsgHeader& header = *reinterpret_cast<const MsgHeader*>(data + pos);
+        if (header.length < sizeof(MsgHeader)) break;  // Malformed; cannot resynchronise
+        if (size - pos < header.length) break;
+
+        const char* msg = data + pos;
+        switch (header.type) {
+            case MsgType::NEW_ORDER:
+                if (header.length >= sizeof(NewOrderMsg)) handler.onNewOrder(*reinterpret_cast<const NewOrderMsg*>(msg));
+                break;
+            case MsgType::CANCEL:
+                if (header.length >= sizeof(CancelMsg)) handler.onCancel(*reinterpret_cast<const CancelMsg*>(msg));
+                break;
+            case MsgType::MODIFY:
+                if (header.length >= sizeof(ModifyMsg)) handler.onModify(*reinterpret_cast<const ModifyMsg*>(msg));
+                break;
+            case MsgType::FILL:
+                if (header.length >= sizeof(FillMsg)) handler.onFill(*reinterpret_cast<const FillMsg*>(msg));
+                break;
+            case MsgType::BOOK_UPDATE:
+                if (header.length >= sizeof(BookUpdateMsg)) {
+                    handler.onBookUpdate(*reinterpret_cast<const BookUpdateMsg*>(msg));
+                }
+                break;
+            case MsgType::ORDER_ACK:
+                if (header.length >= sizeof(OrderAckMsg)) handler.onOrderAck(*reinterpret_cast<const OrderAckMsg*>(msg));
+                break;
+        }
+        pos += header.length;
+    }
+    return pos;
+}
+
+/**
+ * @class MsgWriter
+ * @brief Encodes wire messages back to back into a buffer allocated once
+ *
+ * Appends fail (and are counted) once the buffer is full; the owner sends
+ * data()/size() and calls clear().
+ */
+class MsgWriter {
+private:
+    std::vector<char> buffer;
+    size_t used = 0;
+    uint64_t overflows = 0;
+
+    template <typename Msg>
+    static Msg blank(MsgType type) {
+        Msg msg{};
+        msg.header = {static_cast<uint16_t>(sizeof(Msg)), type, kWireVersion};
+        return msg;
+    }
+
+public:
+    explicit MsgWriter(size_t capacity = 1 << 16) : buffer(capacity) {}
+
+    template <typename Msg>
+    bool append(const Msg& msg) {
+        if (buffer.size() - used < sizeof(Msg)) {
+            ++overflows;
+            return false;
+        }
+        std::memcpy(buffer.data() + used, &msg, sizeof(Msg));
+        used += sizeof(Msg);
+        return true;
+    }
+
+    bool newOrder(uint32_t symbol, uint64_t order_id, Side side, OrderType type, Price price,
+                  uint64_t quantity, const OrderOptions& options = {}) {
+        NewOrderMsg msg = blank<NewOrderMsg>(MsgType::NEW_ORDER);
+        msg.symbol = symbol;
+        msg.order_id = order_id;
+        msg.price = price;
+        msg.quantity = quantity;
+        msg.stop_price = options.stop_price;
+        msg.display_quantity = options.display_quantity;
+        msg.side = static_cast<uint8_t>(side);
+        msg.type = static_cast<uint8_t>(type);
+        msg.account = options.account;
+        return append(msg);
+    }
+
+    bool cancel(uint32_t symbol, uint64_t order_id) {
+        CancelMsg msg = blank<CancelMsg>(MsgType::CANCEL);
+        msg.symbol = symbol;
+        msg.order_id = order_id;
+        return append(msg);
+    }
+
+    bool modify(uint32_t symbol, uint64_t order_id, Price price, uint64_t quantity) {
+        ModifyMsg msg = blank<ModifyMsg>(MsgType::MODIFY);
+        msg.symbol = symbol;
+        msg.order_id = order_id;
+        msg.price = price;
+        msg.quantity = quantity;
+        return append(msg);
+    }
+
+    bool fill(uint32_t symbol, const Trade& trade) {
+        FillMsg msg = blank<FillMsg>(MsgType::FILL);
+        msg.symbol = symbol;
+        msg.buy_order_id = trade.buy_order_id;
+        msg.sell_order_id = trade.sell_order_id;
+        msg.price = trade.price;
+        msg.quantity = trade.quantity;
+        msg.timestamp = trade.timestamp;
+        return append(msg);
+    }
+
+    bool bookUpdate(uint32_t symbol, Side side, Price price, uint64_t quantity, uint32_t order_count) {
+        BookUpdateMsg msg = blank<BookUpdateMsg>(MsgType::BOOK_UPDATE);
+        msg.symbol = symbol;
+        msg.price = price;
+        msg.quantity = quantity;
+        msg.order_count = order_count;
+        msg.side = static_cast<uint8_t>(side);
+        return append(msg);
+    }
+
+    bool orderAck(uint32_t symbol, uint64_t order_id, AckStatus status) {
+        OrderAckMsg msg = blank<OrderAckMsg>(MsgType::ORDER_ACK);
+        msg.symbol = symbol;
+        msg.order_id = order_id;
+        msg.status = static_cast<uint8_t>(status);
+        return append(msg);
+    }
+
+    const char* data() const { return buffer.data(); }
+    size_t size() const { return used; }
+    size_t capacity() const { return buffer.size(); }
+    uint64_t overflowCount() const { return overflows; }
+    void clear() { used = 0; }
+};
+
+/**
+ * @class WireTradeSink
+ * @brief Book trade sink that encodes each fill straight into a MsgWriter
+ *
+ * `BasicOrderBook<TscClock, WireTradeSink> book(instrument, capacity, writer, symbol);`
+ */
+class WireTradeSink {
+private:
+    MsgWriter& writer;
+    uint32_t symbol;
+
+public:
+    WireTradeSink(MsgWriter& writer_, uint32_t symbol_) : writer(writer_), symbol(symbol_) {}
+
+    void onTrade(const Trade& trade) { writer.fill(symbol, trade); }
+};
+
+/**
+ * @struct JournalRecord
+ * @brief Header of one journaled inbound message; the wire message follows, padded to 8 bytes
+ */
+struct JournalRecord {
+    uint32_t length;    // Header plus padded message; 0 where a segment's records end
+    uint32_t checksum;  // Over the sequence number and the message bytes
+    uint64_t sequence;  // Journal sequence number, consecutive from 1
+};
+
+static_assert(sizeof(JournalRecord) == 16, "journal layout");
+
+/**
+ * @struct JournalConfig
+ * @brief Where a Journal keeps its segments and how often it syncs them
+ */
+struct JournalConfig {
+    std::string dir = ".";
+    size_t segment_bytes = 64 << 20;  // Preallocated size of each segment file
+    uint64_t sync_interval_us = 100;  // I/O thread pause between group commits
+};
+
+/**
+ * @struct JournalRecovery
+ * @brief Outcome of scanning a journal directory
+ */
+struct JournalRecovery {
+    uint64_t records = 0;        // Valid records found
+    uint64_t replayed = 0;       // Records handed to the handler (sequence after the starting point)
+    uint64_t last_sequence = 0;  // Sequence of the last valid record
+    uint32_t last_segment = 0;   // Segment holding it (0 if the journal is empty)
+    size_t end_offset = 0;       // Byte offset just past it in that segment
+};
+
+/**
+ * @class Journal
+ * @brief Append-only write-ahead log of inbound wire messages with group commit
+ *
+ * The matching thread calls append() before applying each message. Append
+ * copies the message, behind a JournalRecord header, into a preallocated
+ * segment file that is memory-mapped and pre-faulted, and publishes the new
+ * end position; it makes no system call. A dedicated I/O thread msyncs
+ * everything appended since its last pass in one call (group commit), then
+ * publishes the highest durable sequence, and keeps the next segment created
+ * and mapped ahead of time so rollover is a pointer swap.
+ *
+ * replay() scans the segments in order and feeds each message to a
+ * MsgHandler (a BookSession rebuilds the book). It stops at the first torn
+ * or out-of-sequence record, so a crash mid-write loses only the messages
+ * that were not yet durable. Opening a Journal on an existing directory
+ * resumes after the last valid record.
+ */
+class Journal {
+private:
+    struct Segment {
+        uint32_t index = 0;
+        int fd = -1;
+        char* base = nullptr;
+        size_t size = 0;
+        size_t used = 0;  // Final end offset, set by the appender before it moves on
+    };
+
+    static constexpr int kOffsetBits = 40;
+
+    JournalConfig config;
+
+    // Appender (matching thread)
+    Segment* active = nullptr;
+    size_t offset = 0;
+    uint64_t next_sequence = 1;
+    uint64_t stalls = 0;  // Rollovers that found no spare segment ready
+    bool open = false;
+
+    // Published by the appender: position (segment << 40 | offset), then sequence
+    alignas(64) std::atomic<uint64_t> committed_pos{0};
+    std::atomic<uint64_t> committed_seq{0};
+    std::atomic<Segment*> spare{nullptr};
+    std::atomic<bool> failed{false};
+
+    // Published by the I/O thread
+    alignas(64) std::atomic<uint64_t> durable_seq{0};
+    std::atomic<uint64_t> group_commits{0};
+    std::atomic<bool> running{true};
+
+    // I/O thread only: mapped segments, oldest (the one being synced) first
+    std::vector<Segment*> mapped;
+    size_t synced_offset = 0;
+    std::thread io;
+
+    static std::string segmentPath(const std::string& dir, uint32_t index) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/journal.%06u", index);
+        return dir + name;
+    }
+
+    static uint32_t checksum(uint64_t sequence, const char* data, size_t n) {
+        uint64_t h = sequence * 0x9e3779b97f4a7c15ULL;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0xff51afd7ed558ccdULL;
+            h ^= h >> 29;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, data + i, n - i);
+        h = (h ^ tail ^ n) * 0xc4ceb9fe1a85ec53ULL;
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    /**
+     * @brief Map segment `index`; a new one is truncated, preallocated and pre-faulted
+     */
+    Segment* mapSegment(uint32_t index, bool create) {
+        std::string path = segmentPath(config.dir, index);
+        int fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        size_t size = config.segment_bytes;
+        if (!create && ::fstat(fd, &st) == 0) size = static_cast<size_t>(st.st_size);
+        if ((create && ::posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0) || size < sizeof(JournalRecord)) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (base == MAP_FAILED) {
+            ::close(fd);
+            return nullptr;
+        }
+        return new Segment{index, fd, static_cast<char*>(base), size, 0};
+    }
+
+    static void unmapSegment(Segment* segment) {
+        ::munmap(segment->base, segment->size);
+        ::close(segment->fd);
+        delete segment;
+    }
+
+    // Flush [from, to) of a segment to disk
+    static void syncRange(const Segment* segment, size_t from, size_t to) {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t start = from & ~(page - 1);
+        if (to > start) ::msync(segment->base + start, to - start, MS_SYNC);
+    }
+
+    void ioLoop() {
+        while (true) {
+            bool stopping = !running.load(std::memory_order_acquire);
+            uint64_t seq = committed_seq.load(std::memory_order_acquire);
+            uint64_t pos = committed_pos.load(std::memory_order_acquire);
+            uint32_t segment = static_cast<uint32_t>(pos >> kOffsetBits);
+            size_t end = static_cast<size_t>(pos & ((1ULL << kOffsetBits) - 1));
+
+            // Finish and release segments the appender has moved past
+            while (mapped.front()->index < segment) {
+                Segment* done = mapped.front();
+                syncRange(done, synced_offset, done->used);
+                unmapSegment(done);
+                mapped.erase(mapped.begin());
+                synced_offset = 0;
+            }
+            if (end > synced_offset) {
+                syncRange(mapped.front(), synced_offset, end);
+                synced_offset = end;
+            }
+            if (seq > durable_seq.load(std::memory_order_relaxed)) {
+                durable_seq.store(seq, std::memory_order_release);
+                group_commits.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (!spare.load(std::memory_order_acquire) && !failed.load(std::memory_order_relaxed)) {
+                Segment* next = mapSegment(mapped.back()->index + 1, true);
+                if (next) {
+                    mapped.push_back(next);
+                    spare.store(next, std::memory_order_release);
+                } else {
+                    failed.store(true, std::memory_order_release);
+                }
+            }
+
+            if (stopping) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(config.sync_interval_us));
+        }
+    }
+
+    // Lowest and highest segment indices present in `dir`, {0, 0} if none
+    static std::pair<uint32_t, uint32_t> segmentRange(const std::string& dir) {
+        std::pair<uint32_t, uint32_t> range{0, 0};
+        DIR* d = ::opendir(dir.c_str());
+        if (!d) return range;
+        while (dirent* entry = ::readdir(d)) {
+            unsigned index;
+            char extra;
+            if (std::sscanf(entry->d_name, "journal.%u%c", &index, &extra) != 1 || index == 0) continue;
+            if (range.first == 0 || index < range.first) range.first = index;
+            if (index > range.second) range.second = index;
+        }
+        ::closedir(d);
+        return range;
+    }
+
+public:
+    /**
+     * @brief Open (or create) the journal in `config.dir`, resuming after its last valid record
+     *
+     * Check ok() afterwards: if the directory or a segment cannot be set up,
+     * append() does nothing and returns 0.
+     */
+    explicit Journal(const JournalConfig& config_ = {}) : config(config_) {
+        MsgHandler none;
+        JournalRecovery tail = replay(config.dir, none);
+        if (tail.last_segment != 0) {
+            active = mapSegment(tail.last_segment, false);
+            if (active) {
+                // Clear any torn record past the tail so a reader stops there cleanly
+                std::memset(active->base + tail.end_offset, 0, active->size - tail.end_offset);
+                offset = tail.end_offset;
+                next_sequence = tail.last_sequence + 1;
+            }
+        } else {
+            active = mapSegment(1, true);
+        }
+        if (!active) return;
+
+        open = true;
+        mapped.push_back(active);
+        synced_offset = offset;
+        committed_pos.store((static_cast<uint64_t>(active->index) << kOffsetBits) | offset, std::memory_order_relaxed);
+        committed_seq.store(next_sequence - 1, std::memory_order_relaxed);
+        durable_seq.store(next_sequence - 1, std::memory_order_relaxed);
+        io = std::thread([this] { ioLoop(); });
+    }
+
+    // Flushes everything appended, then stops the I/O thread
+    ~Journal() {
+        if (!open) return;
+        running.store(false, std::memory_order_release);
+        io.join();
+        for (Segment* segment : mapped) unmapSegment(segment);
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    bool ok() const { return open; }
+
+    /**
+     * @brief Record one wire message (matching thread only)
+     * @return Its journal sequence number, or 0 if the journal is not open
+     *         or no further segment could be created
+     */
+    template <typename Msg>
+    uint64_t append(const Msg& msg) {
+        if (!open) return 0;
+        size_t length = msg.header.length;
+        size_t need = (sizeof(JournalRecord) + length + 7) & ~size_t(7);
+        if (offset + need > active->size) {
+            active->used = offset;
+            Segment* next;
+            while (!(next = spare.exchange(nullptr, std::memory_order_acq_rel))) {
+                if (failed.load(std::memory_order_acquire)) return 0;
+                ++stalls;
+                std::this_thread::yield();
+            }
+            active = next;
+            offset = 0;
+        }
+
+        uint64_t seq = next_sequence++;
+        const char* bytes = reinterpret_cast<const char*>(&msg);
+        char* dst = active->base + offset;
+        JournalRecord record{static_cast<uint32_t>(need), checksum(seq, bytes, length), seq};
+        std::memcpy(dst + sizeof(JournalRecord), bytes, length);
+        std::memcpy(dst, &record, sizeof(JournalRecord));
+        offset += need;
+
+        committed_pos.store((static_cast<uint64_t>(active->index) << kOffsetBits) | offset, std::memory_order_release);
+        committed_seq.store(seq, std::memory_order_release);
+        return seq;
+    }
+
+    /**
+     * @brief Highest sequence number known to be on disk
+     *
+     * Callers that must not acknowledge an order before it is durable hold
+     * the ack until this reaches the order's sequence.
+     */
+    uint64_t durableSequence() const { return durable_seq.load(std::memory_order_acquire); }
+
+    // Spin until `sequence` is durable
+    void waitDurable(uint64_t sequence) const {
+        while (durableSequence() < sequence && !failed.load(std::memory_order_acquire)) std::this_thread::yield();
+    }
+
+    uint64_t lastSequence() const { return next_sequence - 1; }
+    uint64_t groupCommits() const { return group_commits.load(std::memory_order_relaxed); }
+    uint64_t rolloverStalls() const { return stalls; }
+
+    // Delete every segment file in `dir` (no Journal may have it open)
+    static void removeSegments(const std::string& dir) {
+        std::pair<uint32_t, uint32_t> range = segmentRange(dir);
+        for (uint32_t index = range.first; index != 0 && index <= range.second; ++index) {
+            ::unlink(segmentPath(dir, index).c_str());
+        }
+    }
+
+    /**
+     * @brief Scan the segments in `dir` in order, passing messages with sequence > `after` to `handler`
+     *
+     * Stops at the first record whose length, sequence or checksum is wrong:
+     * everything before it is exactly what was appended. Deterministic when
+     * `handler` is a BookSession on a fresh book, since the book assigns IDs
+     * and queue priority from the order of messages alone.
+     */
+    template <typename Handler>
+    static JournalRecovery replay(const std::string& dir, Handler& handler, uint64_t after = 0) {
+        JournalRecovery result;
+        std::pair<uint32_t, uint32_t> range = segmentRange(dir);
+        if (range.first == 0) return result;
+
+        uint64_t expected = 0;  // Taken from the first record found
+        bool torn = false;
+        for (uint32_t index = range.first; index <= range.second && !torn; ++index) {
+            int fd = ::open(segmentPath(dir, index).c_str(), O_RDONLY);
+            if (fd < 0) break;
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(JournalRecord))) {
+                ::close(fd);
+                break;
+            }
+            size_t size = static_cast<size_t>(st.st_size);
+            void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (map == MAP_FAILED) break;
+            ::madvise(map, size, MADV_SEQUENTIAL);
+
+            const char* base = static_cast<const char*>(map);
+            size_t pos = 0;
+            while (pos + sizeof(JournalRecord) <= size) {
+                JournalRecord record;
+                std::memcpy(&record, base + pos, sizeof(record));
+                if (record.length == 0) break;  // End of this segment's records
+
+                MsgHeader header;
+                const char* msg = base + pos + sizeof(JournalRecord);
+                bool fits = record.length >= sizeof(JournalRecord) + sizeof(MsgHeader) &&
+                            record.length % 8 == 0 && pos + record.length <= size;
+                if (fits) std::memcpy(&header, msg, sizeof(header));
+                // Records at or before `after` are already reflected in the caller's
+                // state (a snapshot), so only their framing is checked
+                if (!fits || header.length < sizeof(MsgHeader) ||
+                    sizeof(JournalRecord) + header.length > record.length ||
+                    (expected != 0 && record.sequence != expected) ||
+                    (record.sequence > after && record.checksum != checksum(record.sequence, msg, header.length))) {
+                    torn = true;
+                    break;
+                }
+
+                if (record.sequence > after) {
+                    decodeMessages(msg, header.length, handler);
+                    ++result.replayed;
+                }
+                ++result.records;
+                result.last_sequence = record.sequence;
+                result.last_segment = index;
+                expected = record.sequence + 1;
+                pos += record.length;
+                result.end_offset = pos;
+            }
+            ::munmap(map, size);
+        }
+        return result;
+    }
+};
+
+/**
+ * @class BookSession
+ * @brief Applies decoded order messages for one symbol to a book, acking each to `reports`
+ *
+ * New orders carrying an order ID keep it (replayed or engine-assigned flow);
+ * ID 0 lets the book assign one. Messages for other symbols are ignored.
+ * Pass a null writer to skip acknowledgements. With a journal, every order
+ * message for the symbol is appended to it before it is applied; recover by
+ * replaying the journal into a session without one. If an append fails the
+ * session latches failed: that message and every later one is acked
+ * REJECTED without touching the book, so the book never holds state the
+ * journal cannot reproduce.
+ */
+template <typename Book>
+class BookSession : public MsgHandler {
+private:
+    Book& book;
+    uint32_t symbol;
+    MsgWriter* reports;
+    Journal* journal;
+    bool journal_failed = false;
+
+    void ack(uint64_t order_id, AckStatus status) {
+        if (reports) reports->orderAck(symbol, order_id, status);
+    }
+
+    // Write `msg` ahead of applying it; false once the journal has refused a message
+    template <typename Msg>
+    bool logged(const Msg& msg) {
+        if (journal && !journal_failed && journal->append(msg) == 0) journal_failed = true;
+        return !journal_failed;
+    }
+
+    AckStatus rejection() const {
+        return book.lastRiskReject() != RiskReject::NONE ? AckStatus::RISK_REJECTED : AckStatus::REJECTED;
+    }
+
+public:
+    BookSession(Book& book_, uint32_t symbol_, MsgWriter* reports_ = nullptr, Journal* journal_ = nullptr)
+        : book(book_), symbol(symbol_), reports(reports_), journal(journal_) {}
+
+    // True once a journal append has failed; the session then rejects everything
+    bool journalFailed() const { return journal_failed; }
+
+    void onNewOrder(const NewOrderMsg& msg) {
+        if (msg.symbol != symbol) return;
+        if (!logged(msg)) {
+            ack(msg.order_id, AckStatus::REJECTED);
+            return;
+        }
+        OrderOptions options;
+        options.stop_price = msg.stop_price;
+        options.display_quantity = msg.display_quantity;
+        options.account = msg.account;
+        Side side = static_cast<Side>(msg.side);
+        OrderType type = static_cast<OrderType>(msg.type);
+        uint64_t order_id = msg.order_id
+            ? book.addOrderTicksWithId(msg.order_id, side, type, msg.price, msg.quantity, options)
+            : book.addOrderTicks(side, type, msg.price, msg.quantity, options);
+        ack(order_id ? order_id : msg.order_id, order_id ? AckStatus::ACCEPTED : rejection());
+    }
+
+    void onCancel(const CancelMsg& msg) {
+        if (msg.symbol != symbol) return;
+        if (!logged(msg)) {
+            ack(msg.order_id, AckStatus::REJECTED);
+            return;
+        }
+        ack(msg.order_id, book.cancelOrder(msg.order_id) ? AckStatus::CANCELLED : AckStatus::UNKNOWN_ORDER);
+    }
+
+    void onModify(const ModifyMsg& msg) {
+        if (msg.symbol != symbol) return;
+        if (!logged(msg)) {
+            ack(msg.order_id, AckStatus::REJECTED);
+            return;
+        }
+        if (!book.modifyOrderTicks(msg.order_id, msg.price, msg.quantity)) {
+            bool risk = book.lastRiskReject() != RiskReject::NONE;
+            ack(msg.order_id, risk ? AckStatus::RISK_REJECTED : AckStatus::UNKNOWN_ORDER);
+        } else {
+            ack(msg.order_id, msg.quantity == 0 ? AckStatus::CANCELLED : AckStatus::MODIFIED);
+        }
+    }
+};
+
+/**
+ * @struct CacheLinePadded
+ * @brief A queue slot rounded up to whole cache lines, so the producer filling
+ *        slot i never shares a line with the consumer reading slot i-1
+ */
+template <typename T>
+struct alignas(64) CacheLinePadded {
+    T value;
+};
+
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free single-producer/single-consumer queue
+ *
+ * Same layout as TradeRing: power-of-two slots allocated once, producer and
+ * consumer indices on separate cache lines, and each side caching its last
+ * view of the other's index so the shared line is only read when the cached
+ * value says the queue looks full (or empty). Batch calls publish or release
+ * a whole run of slots with one index store.
+ */
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<CacheLinePadded<T>> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<uint64_t> tail{0};  // Written by the producer
+    uint64_t cached_head = 0;                   // Producer's last view of head
+
+    alignas(64) std::atomic<uint64_t> head{0};  // Written by the consumer
+    uint64_t cached_tail = 0;                   // Consumer's last view of tail
+
+public:
+    // @param capacity Number of slots, rounded up to a power of two
+    explicit SpscQueue(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side; false if the queue is full
+    bool tryPush(const T& item) { return pushBatch(&item, 1) == 1; }
+
+    /**
+     * @brief Enqueue up to `n` items (producer side)
+     * @return Number enqueued, fewer than `n` only when the queue fills
+     */
+    size_t pushBatch(const T* items, size_t n) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (slots.size() - (t - cached_head) < n) cached_head = head.load(std::memory_order_acquire);
+        n = std::min<size_t>(n, slots.size() - (t - cached_head));
+        for (size_t i = 0; i < n; ++i) slots[(t + i) & mask].value = items[i];
+        if (n > 0) tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side; false if the queue is empty
+    bool tryPop(T& item) {
+        return drain([&item](const T& value) { item = value; }, 1) == 1;
+    }
+
+    /**
+     * @brief Hand up to `max` queued items to `f` in order (consumer side)
+     * @return Number of items consumed
+     */
+    template <typename F>
+    size_t drain(F&& f, size_t max = SIZE_MAX) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) cached_tail = tail.load(std::memory_order_acquire);
+        size_t n = static_cast<size_t>(std::min<uint64_t>(cached_tail - h, max));
+        for (size_t i = 0; i < n; ++i) f(slots[(h + i) & mask].value);
+        if (n > 0) head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    size_t capacity() const { return slots.size(); }
+};
+
+/**
+ * @class MpscQueue
+ * @brief Bounded lock-free multi-producer/single-consumer queue
+ *
+ * Producers claim slots by advancing a shared tail with compare-and-swap and
+ * publish each slot through its own sequence number; the consumer owns the
+ * head outright. Each slot, with its sequence, fills whole cache lines. A
+ * slot is free for position p when its sequence equals p and holds data when
+ * it equals p + 1; the consumer frees slots strictly in order, so a batch
+ * claim only has to find a run of free slots starting at the tail.
+ */
+template <typename T>
+class MpscQueue {
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence{0};
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t size;
+    size_t mask;
+
+    alignas(64) std::atomic<uint64_t> tail{0};  // Claimed by producers
+    alignas(64) uint64_t head = 0;              // Consumer only
+
+public:
+    // @param capacity Number of slots, rounded up to a power of two
+    explicit MpscQueue(size_t capacity) {
+        size = 1;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread; false if the queue is full
+    bool tryPush(const T& item) { return pushBatch(&item, 1) == 1; }
+
+    /**
+     * @brief Enqueue up to `n` items as one contiguous run (any thread)
+     * @return Number enqueued, fewer than `n` only when the queue fills
+     */
+    size_t pushBatch(const T* items, size_t n) {
+        if (n == 0) return 0;
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t lag = static_cast<int64_t>(slots[t & mask].sequence.load(std::memory_order_acquire) - t);
+            if (lag < 0) return 0;  // Still holds an item from the previous lap
+            if (lag > 0) {          // Another producer claimed it; catch up
+                t = tail.load(std::memory_order_relaxed);
+                continue;
+            }
+            size_t k = 1;
+            while (k < n && slots[(t + k) & mask].sequence.load(std::memory_order_acquire) == t + k) ++k;
+            if (tail.compare_exchange_weak(t, t + k, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < k; ++i) {
+                    Slot& slot = slots[(t + i) & mask];
+                    slot.value = items[i];
+                    slot.sequence.store(t + i + 1, std::memory_order_release);
+                }
+                return k;
+            }
+        }
+    }
+
+    // Consumer side; false if the queue is empty
+    bool tryPop(T& item) {
+        return drain([&item](const T& value) { item = value; }, 1) == 1;
+    }
+
+    /**
+     * @brief Hand up to `max` published items to `f` in claim order (consumer side)
+     *
+     * Stops early at a slot that is claimed but not yet published.
+     * @return Number of items consumed
+     */
+    template <typename F>
+    size_t drain(F&& f, size_t max = SIZE_MAX) {
+        size_t n = 0;
+        while (n < max) {
+            Slot& slot = slots[head & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) break;
+            f(slot.value);
+            slot.sequence.store(head + size, std::memory_order_release);
+            ++head;
+            ++n;
+        }
+        return n;
+    }
+
+    size_t capacity() const { return size; }
+};
+
+/**
+ * @brief Pin `thread` to one CPU (Linux; a no-op elsewhere)
+ */
+inline void pinThread(std::thread& thread, unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+    (void)thread;
+    (void)cpu;
+#endif
+}
+
+/**
+ * @struct OrderRequest
+ * @brief Inbound engine message, addressed to one symbol's book
+ */
+struct OrderRequest {
+    enum class Kind : uint8_t { NEW, CANCEL, MODIFY };
+
+    Kind kind;
+    Side side;
+    OrderType type;
+    uint32_t symbol;       // Index into the engine's instrument list
+    uint64_t order_id;     // Engine-assigned for NEW; target order for CANCEL and MODIFY
+    Price price;           // Limit price (NEW) or new price (MODIFY), in ticks
+    uint64_t quantity;
+    OrderOptions options;  // NEW only
+};
+
+using EngineTradeHandler = std::function<void(uint32_t symbol, const Trade&)>;
+
+/**
+ * @struct EngineTradeSink
+ * @brief Trade sink of an engine book: counts each fill for its shard and
+ *        forwards it to the engine's handler as it happens, on the shard's thread
+ */
+struct EngineTradeSink {
+    uint32_t symbol;
+    uint64_t* trades;                   // The owning shard's fill count
+    const EngineTradeHandler* handler;  // May be empty
+
+    EngineTradeSink(uint32_t symbol_, uint64_t* trades_, const EngineTradeHandler* handler_)
+        : symbol(symbol_), trades(trades_), handler(handler_) {}
+
+    void onTrade(const Trade& trade) {
+        ++*trades;
+        if (*handler) (*handler)(symbol, trade);
+    }
+};
+
+// The book type `Book` with its trade sink replaced by `Sink`
+template <typename Book, typename Sink>
+struct WithTradeSink;
+
+template <typename Clock, typename TradeSink, typename IdHash, typename DepthSink, typename Latency,
+          typename Risk, typename Allocation, typename Sink>
+struct WithTradeSink<BasicOrderBook<Clock, TradeSink, IdHash, DepthSink, Latency, Risk, Allocation>, Sink> {
+    using type = BasicOrderBook<Clock, Sink, IdHash, DepthSink, Latency, Risk, Allocation>;
+};
+
+/**
+ * @struct EngineConfig
+ * @brief Shard layout, ingress queues and per-book sizing for MatchingEngine
+ */
+struct EngineConfig {
+    std::vector<uint32_t> shard_of;  // Symbol index -> shard; its maximum + 1 is the shard count
+    std::vector<int> cpus;           // Shard -> CPU to pin its thread to; empty leaves threads unpinned
+    size_t gateways = 1;             // Dedicated connections, each with an SPSC queue into every shard
+    size_t orders_per_book = 1 << 14;
+    EngineTradeHandler on_trade;     // Every fill as it happens, on its shard's thread; may be empty
+    size_t queue_capacity = 1 << 16;
+    size_t drain_batch = 64;         // Most requests taken from one queue before polling the next
+
+    // Spread `symbols` over `shards` round-robin
+    static EngineConfig roundRobin(size_t symbols, uint32_t shards) {
+        EngineConfig config;
+        config.shard_of.resize(symbols);
+        for (size_t i = 0; i < symbols; ++i) config.shard_of[i] = static_cast<uint32_t>(i % shards);
+        return config;
+    }
+};
+
+/**
+ * @class BasicMatchingEngine
+ * @brief Many books of type `Book`, partitioned across matching threads by symbol
+ *
+ * Each shard owns its books, its ingress queues and its counters outright and
+ * runs on its own thread (pinned to a CPU when EngineConfig::cpus says so);
+ * shards share nothing mutable, so adding cores adds matching capacity.
+ *
+ * Requests reach a shard two ways. Each Gateway (one per connection, used by
+ * one thread) has its own SPSC queue into every shard. The engine's own
+ * submit calls are safe from any thread and go through one MPSC queue per
+ * shard. A shard's event loop drains its queues round-robin, up to
+ * `drain_batch` requests from each per pass.
+ *
+ * Order IDs are engine-wide: every gateway and the shared path number their
+ * orders in a separate residue class, so no ID counter is shared between
+ * threads. Books take them via addOrderTicksWithId. Books may be read only
+ * after stop().
+ *
+ * Shards run `Book` with its trade sink swapped for an EngineTradeSink, so
+ * every fill is counted for its shard and handed to EngineConfig::on_trade
+ * from inside the match loop; no fill can be lost between requests.
+ */
+template <typename Book = OrderBook>
+class BasicMatchingEngine {
+public:
+    using ShardBook = typename WithTradeSink<Book, EngineTradeSink>::type;
+
+private:
+    struct alignas(64) Shard {
+        std::vector<std::unique_ptr<ShardBook>> books;                   // By position in the shard
+        std::vector<std::unique_ptr<SpscQueue<OrderRequest>>> connections;  // By gateway
+        MpscQueue<OrderRequest> shared;
+        std::thread thread;
+        uint64_t processed = 0;                                          // Written by the shard thread only
+        uint64_t trades = 0;                                             // Written by the shard thread only
+
+        explicit Shard(size_t queue_capacity) : shared(queue_capacity) {}
+    };
+
+    struct Route {
+        uint32_t shard;
+        uint32_t book;
+    };
+
+    std::vector<Instrument> instruments;
+    std::vector<Route> routes;  // By symbol index; fixed after construction
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t drain_batch;
+    uint64_t id_stride;         // Gateways + 1 ID lanes; lane 0 is the shared path
+    EngineTradeHandler on_trade;
+    std::atomic<bool> stopping{false};
+    bool stopped = false;
+
+    alignas(64) std::atomic<uint64_t> next_shared_id{0};
+
+public:
+    /**
+     * @class Gateway
+     * @brief One order-entry connection: an SPSC queue into every shard and its own ID lane
+     *
+     * Not thread-safe; each gateway belongs to one producer thread.
+     */
+    class alignas(64) Gateway {
+    private:
+        BasicMatchingEngine& engine;
+        size_t index;
+        uint64_t next_id = 0;
+
+        uint64_t assignId() { return ++next_id * engine.id_stride + index + 1; }
+
+        SpscQueue<OrderRequest>& queueFor(uint32_t symbol) {
+            return *engine.shards[engine.routes[symbol].shard]->connections[index];
+        }
+
+    public:
+        Gateway(BasicMatchingEngine& engine_, size_t index_) : engine(engine_), index(index_) {}
+
+        /**
+         * @brief Queue a new order for `symbol`, prices in ticks
+         * @return The engine-assigned order ID (the book may still reject the order)
+         */
+        uint64_t submitNew(uint32_t symbol, Side side, OrderType type, Price price, uint64_t quantity,
+                           const OrderOptions& options = {}) {
+            uint64_t order_id = assignId();
+            send({OrderRequest::Kind::NEW, side, type, symbol, order_id, price, quantity, options});
+            return order_id;
+        }
+
+        void submitCancel(uint32_t symbol, uint64_t order_id) {
+            send({OrderRequest::Kind::CANCEL, Side::BUY, OrderType::LIMIT, symbol, order_id, 0, 0, {}});
+        }
+
+        void submitModify(uint32_t symbol, uint64_t order_id, Price new_price, uint64_t new_quantity) {
+            send({OrderRequest::Kind::MODIFY, Side::BUY, OrderType::LIMIT, symbol, order_id,
+                  new_price, new_quantity, {}});
+        }
+
+        /**
+         * @brief Queue a run of requests, enqueuing consecutive ones for the same shard as one batch
+         *
+         * NEW requests get their order IDs assigned in place.
+         */
+        void submitBatch(OrderRequest* requests, size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                if (requests[i].kind == OrderRequest::Kind::NEW) requests[i].order_id = assignId();
+            }
+            size_t begin = 0;
+            while (begin < n) {
+                uint32_t shard = engine.routes[requests[begin].symbol].shard;
+                size_t end = begin + 1;
+                while (end < n && engine.routes[requests[end].symbol].shard == shard) ++end;
+                SpscQueue<OrderRequest>& queue = queueFor(requests[begin].symbol);
+                while (begin < end) {
+                    size_t pushed = queue.pushBatch(requests + begin, end - begin);
+                    if (pushed == 0) std::this_thread::yield();
+                    begin += pushed;
+                }
+            }
+        }
+
+        /**
+         * @brief Decode wire messages and queue the order messages among them
+         *
+         * NEW_ORDER messages with ID 0 get an ID from this gateway's lane; nonzero
+         * IDs are taken as given (replayed flow) and must not collide with engine
+         * IDs. Messages for unknown symbols and outbound types are dropped.
+         *
+         * @return Bytes consumed (see decodeMessages)
+         */
+        size_t submitMessages(const char* data, size_t size) {
+            struct Router : MsgHandler {
+                Gateway& gateway;
+                explicit Router(Gateway& gateway_) : gateway(gateway_) {}
+
+                bool known(uint32_t symbol) const { return symbol < gateway.engine.routes.size(); }
+
+                void onNewOrder(const NewOrderMsg& msg) {
+                    if (!known(msg.symbol)) return;
+                    OrderOptions options;
+                    options.stop_price = msg.stop_price;
+                    options.display_quantity = msg.display_quantity;
+                    options.account = msg.account;
+                    gateway.send({OrderRequest::Kind::NEW, static_cast<Side>(msg.side),
+                                  static_cast<OrderType>(msg.type), msg.symbol,
+                                  msg.order_id ? msg.order_id : gateway.assignId(), msg.price, msg.quantity,
+                                  options});
+                }
+
+                void onCancel(const CancelMsg& msg) {
+                    if (known(msg.symbol)) gateway.submitCancel(msg.symbol, msg.order_id);
+                }
+
+                void onModify(const ModifyMsg& msg) {
+                    if (known(msg.symbol)) gateway.submitModify(msg.symbol, msg.order_id, msg.price, msg.quantity);
+                }
+            } router(*this);
+            return decodeMessages(data, size, router);
+        }
+
+        // Queue one addressed request, waiting while the shard's queue is full
+        void send(const OrderRequest& request) {
+            SpscQueue<OrderRequest>& queue = queueFor(request.symbol);
+            while (!queue.tryPush(request)) std::this_thread::yield();
+        }
+    };
+
+private:
+    std::vector<std::unique_ptr<Gateway>> gateways;
+
+    static void apply(ShardBook& book, const OrderRequest& request) {
+        switch (request.kind) {
+            case OrderRequest::Kind::NEW:
+                book.addOrderTicksWithId(request.order_id, request.side, request.type, request.price,
+                                         request.quantity, request.options);
+                break;
+            case OrderRequest::Kind::CANCEL:
+                book.cancelOrder(request.order_id);
+                break;
+            case OrderRequest::Kind::MODIFY:
+                book.modifyOrderTicks(request.order_id, request.price, request.quantity);
+                break;
+        }
+    }
+
+    /**
+     * @brief Shard event loop: drain every ingress queue in batches until stopped and empty
+     */
+    void run(Shard& shard) {
+        auto dispatch = [this, &shard](const OrderRequest& request) {
+            apply(*shard.books[routes[request.symbol].book], request);
+        };
+        while (true) {
+            bool done = stopping.load(std::memory_order_acquire);
+            size_t n = 0;
+            for (auto& connection : shard.connections) n += connection->drain(dispatch, drain_batch);
+            n += shard.shared.drain(dispatch, drain_batch);
+            shard.processed += n;
+            if (n == 0) {
+                if (done) break;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void submitShared(const OrderRequest& request) {
+        MpscQueue<OrderRequest>& queue = shards[routes[request.symbol].shard]->shared;
+        while (!queue.tryPush(request)) std::this_thread::yield();
+    }
+
+public:
+    /**
+     * @param instruments_ Tradable instruments; a symbol's index in this list addresses it
+     * @param config Shard assignment (one entry per instrument), gateway count and sizing
+     */
+    BasicMatchingEngine(const std::vector<Instrument>& instruments_, const EngineConfig& config)
+        : instruments(instruments_), routes(instruments_.size()), drain_batch(config.drain_batch),
+          id_stride(config.gateways + 1), on_trade(config.on_trade) {
+        uint32_t shard_count = 0;
+        for (uint32_t s : config.shard_of) shard_count = std::max(shard_count, s + 1);
+        for (uint32_t s = 0; s < shard_count; ++s) {
+            shards.push_back(std::make_unique<Shard>(config.queue_capacity));
+            for (size_t g = 0; g < config.gateways; ++g) {
+                shards.back()->connections.push_back(
+                    std::make_unique<SpscQueue<OrderRequest>>(config.queue_capacity));
+            }
+        }
+        for (size_t g = 0; g < config.gateways; ++g) gateways.push_back(std::make_unique<Gateway>(*this, g));
+
+        for (size_t i = 0; i < instruments.size(); ++i) {
+            Shard& shard = *shards[config.shard_of[i]];
+            routes[i] = {config.shard_of[i], static_cast<uint32_t>(shard.books.size())};
+            shard.books.push_back(std::make_unique<ShardBook>(instruments[i], config.orders_per_book,
+                                                              static_cast<uint32_t>(i), &shard.trades, &on_trade));
+        }
+
+        for (uint32_t s = 0; s < shard_count; ++s) {
+            Shard& shard = *shards[s];
+            shard.thread = std::thread([this, &shard] { run(shard); });
+            if (s < config.cpus.size()) pinThread(shard.thread, static_cast<unsigned>(config.cpus[s]));
+        }
+    }
+
+    ~BasicMatchingEngine() { stop(); }
+
+    BasicMatchingEngine(const BasicMatchingEngine&) = delete;
+    BasicMatchingEngine& operator=(const BasicMatchingEngine&) = delete;
+
+    Gateway& gateway(size_t index) { return *gateways[index]; }
+
+    /**
+     * @brief Queue a new order for `symbol` from any thread, prices in ticks
+     * @return The engine-assigned order ID (the book may still reject the order)
+     */
+    uint64_t submitNew(uint32_t symbol, Side side, OrderType type, Price price, uint64_t quantity,
+                       const OrderOptions& options = {}) {
+        uint64_t order_id = (next_shared_id.fetch_add(1, std::memory_order_relaxed) + 1) * id_stride;
+        submitShared({OrderRequest::Kind::NEW, side, type, symbol, order_id, price, quantity, options});
+        return order_id;
+    }
+
+    void submitCancel(uint32_t symbol, uint64_t order_id) {
+        submitShared({OrderRequest::Kind::CANCEL, Side::BUY, OrderType::LIMIT, symbol, order_id, 0, 0, {}});
+    }
+
+    void submitModify(uint32_t symbol, uint64_t order_id, Price new_price, uint64_t new_quantity) {
+        submitShared({OrderRequest::Kind::MODIFY, Side::BUY, OrderType::LIMIT, symbol, order_id,
+                      new_price, new_quantity, {}});
+    }
+
+    /**
+     * @brief Let every shard drain its queues, then join the matching threads
+     *
+     * Call once all producers have finished submitting.
+     */
+    void stop() {
+        if (stopped) return;
+        stopping.store(true, std::memory_order_release);
+        for (auto& shard : shards) shard->thread.join();
+        stopped = true;
+    }
+
+    size_t shardCount() const { return shards.size(); }
+    size_t symbolCount() const { return instruments.size(); }
+    uint64_t processed(size_t shard) const { return shards[shard]->processed; }
+    uint64_t trades(size_t shard) const { return shards[shard]->trades; }
+
+    const ShardBook& book(uint32_t symbol) const {
+        const Route& route = routes[symbol];
+        return *shards[route.shard]->books[route.book];
+    }
+
+    /**
+     * @brief A book for setup before its first request, e.g. risk limits or an auction
+     *
+     * Writes made before a request for `symbol` is submitted reach the shard
+     * thread with that request; after that the book belongs to the shard
+     * thread until stop().
+     */
+    ShardBook& book(uint32_t symbol) {
+        const Route& route = routes[symbol];
+        return *shards[route.shard]->books[route.book];
+    }
+};
+
+using MatchingEngine = BasicMatchingEngine<>;
+
+#endif  // ORDERBOOK_HPP
@@ -0,0 +1,684 @@
+/**
+ * @file replay.cpp
+ * @brief Rebuild order books from a recorded L3 feed in a memory-mapped file
+ *
+ * Input formats:
+ * - NASDAQ TotalView-ITCH 5.0 (BinaryFILE framing: 2-byte big-endian length
+ *   before each message). Add, execute, cancel, delete and replace messages
+ *   drive one book per stock locate; other message types are skipped.
+ * - The simulator's own binary protocol (--wire), applied through BookSession
+ *
+ * The file is mapped read-only with sequential-access and rolling
+ * will-need hints, decoded in place, and replayed as fast as possible or
+ * paced at the recorded timestamps. --generate writes a synthetic ITCH file
+ * for benchmarking when no recorded feed is at hand.
+ *
+ * Usage:
+ *   ./replay FILE [--pace SPEED] [--symbols AAPL,MSFT] [--band FRACTION]
+ *                 [--orders-per-book N] [--top N]
+ *   ./replay --wire FILE [--orders-per-book N] [--top N]
+ *   ./replay --generate FILE [--messages N] [--stocks N] [--uniform]
+ *
+ * Compile: g++ -std=c++17 -O3 -pthread -o replay replay.cpp
+ */
+
+#include "orderbook.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @class MappedFile
+ * @brief Read-only private mapping of a whole file with readahead hints
+ *
+ * The kernel is told the mapping is read sequentially, and willNeed() asks
+ * for the window ahead of the reader to be paged in before it gets there.
+ */
+class MappedFile {
+private:
+    int fd = -1;
+    const char* base = nullptr;
+    size_t length = 0;
+    size_t window;
+    size_t next_hint = 0;  // Offset at which the next hint is due
+
+public:
+    explicit MappedFile(size_t window_ = 64 << 20) : window(window_) {}
+
+    ~MappedFile() {
+        if (base) munmap(const_cast<char*>(base), length);
+        if (fd >= 0) close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // @return false (with errno set) if the file cannot be opened or mapped
+    bool open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        length = static_cast<size_t>(st.st_size);
+        if (length == 0) return true;
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) return false;
+        base = static_cast<const char*>(p);
+        madvise(p, length, MADV_SEQUENTIAL);
+        madvise(p, std::min(2 * window, length), MADV_WILLNEED);
+        next_hint = window;
+        return true;
+    }
+
+    /**
+     * @brief Keep the next two windows past `offset` on their way into memory
+     *
+     * Cheap to call per message: it issues a hint only when `offset` crosses
+     * into a new window.
+     */
+    void willNeed(size_t offset) {
+        if (offset < next_hint || !base) return;
+        size_t ahead = offset - offset % window + window;
+        if (ahead < length) {
+            madvise(const_cast<char*>(base) + ahead, std::min(2 * window, length - ahead), MADV_WILLNEED);
+        }
+        next_hint = ahead;
+    }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// ITCH fields are big-endian and unaligned
+static uint16_t be16(const char* p) { uint16_t v; std::memcpy(&v, p, 2); return __builtin_bswap16(v); }
+static uint32_t be32(const char* p) { uint32_t v; std::memcpy(&v, p, 4); return __builtin_bswap32(v); }
+static uint64_t be64(const char* p) { uint64_t v; std::memcpy(&v, p, 8); return __builtin_bswap64(v); }
+static uint64_t be48(const char* p) { return (static_cast<uint64_t>(be16(p)) << 32) | be32(p + 2); }
+
+static void put16(std::string& out, uint16_t v) { v = __builtin_bswap16(v); out.append(reinterpret_cast<char*>(&v), 2); }
+static void put32(std::string& out, uint32_t v) { v = __builtin_bswap32(v); out.append(reinterpret_cast<char*>(&v), 4); }
+static void put64(std::string& out, uint64_t v) { v = __builtin_bswap64(v); out.append(reinterpret_cast<char*>(&v), 8); }
+static void put48(std::string& out, uint64_t v) { put16(out, static_cast<uint16_t>(v >> 32)); put32(out, static_cast<uint32_t>(v)); }
+
+/**
+ * @struct FeedClock
+ * @brief Timestamp policy returning the recorded time of the message being replayed,
+ *        so book and trade timestamps match the feed rather than the replay host
+ */
+struct FeedClock {
+    static inline uint64_t current = 0;  // Nanoseconds since midnight, set per message
+    uint64_t now() const { return current; }
+};
+
+/**
+ * @struct CrossingCounter
+ * @brief Trade sink for feed replay: the venue already matched, so a fill here
+ *        means an add crossed the rebuilt book, which is counted
+ */
+struct CrossingCounter {
+    uint64_t fills = 0;
+    void onTrade(const Trade&) { ++fills; }
+};
+
+// ITCH order references are issued in ascending order, so the identity hash keeps
+// recently added orders in neighbouring index slots
+using ReplayBook = BasicOrderBook<FeedClock, CrossingCounter, DenseIdHash>;
+
+struct ReplayConfig {
+    double pace = 0.0;            // Replay speed relative to recorded time; 0 = as fast as possible
+    double band = 0.1;            // Ladder half-width as a fraction of a stock's first price
+    size_t orders_per_book = 1 << 20;  // Cap on any one book's pool
+    size_t top = 10;              // Books listed in the final report
+    std::vector<std::string> symbols;  // Only these stocks; empty = all
+};
+
+/**
+ * @class ItchReplayer
+ * @brief Applies ITCH 5.0 order messages to one ReplayBook per stock locate
+ *
+ * A stock's book is created at its first add, with a ladder centred on that
+ * price. Stocks priced at $1 or more use a one-cent tick; below that, the
+ * feed's 1/10000 dollar unit. Adds outside the ladder or beyond the book's
+ * capacity are rejected and counted, and so are later messages that refer to them.
+ *
+ * A sizing pass over the file first bounds each stock's resting orders by
+ * the running maximum of adds minus deletes, so each book's pool is only as
+ * large as that stock needs (capped at `orders_per_book`).
+ */
+class ItchReplayer {
+private:
+    struct Stock {
+        std::string name;
+        bool wanted = true;
+        uint32_t divisor = 0;  // Feed price units per tick; 0 until the book exists
+        uint64_t messages = 0;
+        int64_t live = 0;      // Sizing pass: adds minus deletes so far
+        int64_t peak = 0;      // Sizing pass: upper bound on orders resting at once
+        std::unique_ptr<ReplayBook> book;
+    };
+
+    ReplayConfig config;
+    std::vector<Stock> stocks;  // By stock locate
+    uint64_t counts[256] = {};
+    uint64_t rejected_adds = 0;
+    uint64_t unknown_refs = 0;
+    uint64_t messages = 0;
+    size_t bytes = 0;
+    double elapsed_ms = 0.0;
+
+    ReplayBook* bookFor(uint16_t locate, uint32_t feed_price) {
+        Stock& stock = stocks[locate];
+        if (!stock.wanted) return nullptr;
+        if (!stock.book) {
+            if (stock.name.empty()) stock.name = "LOC" + std::to_string(locate);
+            stock.divisor = feed_price >= 10000 ? 100 : 1;
+            double tick = stock.divisor / 10000.0;
+            Price ref_ticks = feed_price / stock.divisor;
+            Price ladder = std::max<Price>(1000, static_cast<Price>(ref_ticks * config.band));
+            Instrument instrument{stock.name, tick, ref_ticks * tick, ladder};
+            size_t capacity = std::min<size_t>(std::max<int64_t>(stock.peak, 64), config.orders_per_book);
+            stock.book = std::make_unique<ReplayBook>(instrument, capacity);
+        }
+        return stock.book.get();
+    }
+
+    void add(const char* m) {
+        uint16_t locate = be16(m + 1);
+        uint32_t price = be32(m + 32);
+        ReplayBook* book = bookFor(locate, price);
+        if (!book) return;
+        ++stocks[locate].messages;
+        Side side = m[19] == 'B' ? Side::BUY : Side::SELL;
+        if (!book->addOrderTicksWithId(be64(m + 11), side, OrderType::LIMIT,
+                                       price / stocks[locate].divisor, be32(m + 20))) {
+            ++rejected_adds;
+        }
+    }
+
+    // Executions (E, C) and partial cancels (X) all reduce a resting order
+    void reduce(const char* m) {
+        Stock& stock = stocks[be16(m + 1)];
+        if (!stock.book) return;
+        ++stock.messages;
+        if (!stock.book->reduceOrder(be64(m + 11), be32(m + 19))) ++unknown_refs;
+    }
+
+    void remove(const char* m) {
+        Stock& stock = stocks[be16(m + 1)];
+        if (!stock.book) return;
+        ++stock.messages;
+        if (!stock.book->cancelOrder(be64(m + 11))) ++unknown_refs;
+    }
+
+    // Replace: the old reference leaves the book, the new one joins at the back of its level
+    void replace(const char* m) {
+        Stock& stock = stocks[be16(m + 1)];
+        if (!stock.book) return;
+        ++stock.messages;
+        const Order* old = stock.book->findOrder(be64(m + 11));
+        if (!old) {
+            ++unknown_refs;
+            return;
+        }
+        Side side = old->side;
+        stock.book->cancelOrder(be64(m + 11));
+        if (!stock.book->addOrderTicksWithId(be64(m + 19), side, OrderType::LIMIT,
+                                             be32(m + 31) / stock.divisor, be32(m + 27))) {
+            ++rejected_adds;
+        }
+    }
+
+    void directory(const char* m) {
+        Stock& stock = stocks[be16(m + 1)];
+        stock.name.assign(m + 11, 8);
+        stock.name.erase(stock.name.find_last_not_of(' ') + 1);
+        if (!config.symbols.empty()) {
+            stock.wanted = std::find(config.symbols.begin(), config.symbols.end(), stock.name) != config.symbols.end();
+        }
+    }
+
+    void apply(const char* m, uint16_t length) {
+        switch (m[0]) {
+            case 'A': if (length >= 36) add(m); break;
+            case 'F': if (length >= 40) add(m); break;
+            case 'E': if (length >= 31) reduce(m); break;
+            case 'C': if (length >= 36) reduce(m); break;
+            case 'X': if (length >= 23) reduce(m); break;
+            case 'D': if (length >= 19) remove(m); break;
+            case 'U': if (length >= 35) replace(m); break;
+            case 'R': if (length >= 39) directory(m); break;
+            default: break;
+        }
+    }
+
+    // Messages naming a resting order start loading it before they are applied
+    void prefetch(const char* m, bool record) const {
+        if (m[0] == 'E' || m[0] == 'C' || m[0] == 'X' || m[0] == 'D' || m[0] == 'U') {
+            const Stock& stock = stocks[be16(m + 1)];
+            if (stock.book) stock.book->prefetchOrder(be64(m + 11), record);
+        }
+    }
+
+public:
+    explicit ItchReplayer(const ReplayConfig& config_) : config(config_), stocks(65536) {
+        // Until a directory message names it, a locate is wanted only if no filter is set
+        for (auto& stock : stocks) stock.wanted = config.symbols.empty();
+    }
+
+    /**
+     * @brief Size every stock's book from the message counts in the file
+     * @return Milliseconds taken
+     */
+    double size(const MappedFile& file) {
+        auto start = std::chrono::steady_clock::now();
+        const char* data = file.data();
+        size_t pos = 0;
+        while (file.size() - pos >= 2) {
+            uint16_t length = be16(data + pos);
+            if (length == 0 || file.size() - pos - 2 < length) break;
+            const char* m = data + pos + 2;
+            if (length >= 3) {
+                Stock& stock = stocks[be16(m + 1)];
+                if (m[0] == 'A' || m[0] == 'F') {
+                    stock.peak = std::max(stock.peak, ++stock.live);
+                } else if (m[0] == 'D') {
+                    --stock.live;
+                }
+            }
+            pos += 2 + length;
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief Replay every complete message in the file
+     *
+     * The reader runs kLookahead messages ahead of the book: it prefetches the
+     * index slot of each referenced order as it frames the message, and the
+     * order record itself kLookahead / 2 messages before applying it, so the
+     * two dependent misses overlap with other messages' work.
+     */
+    void replay(MappedFile& file) {
+        static constexpr size_t kLookahead = 16;
+        const char* data = file.data();
+        size_t size = file.size();
+        size_t framed[kLookahead];  // Offsets of framed messages not yet applied
+        uint64_t n_framed = 0;
+        size_t ahead = 0;           // Offset of the next message to frame
+        uint64_t first_ts = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        while (true) {
+            while (n_framed - messages < kLookahead && size - ahead >= 2) {
+                uint16_t length = be16(data + ahead);
+                if (length == 0 || size - ahead - 2 < length) break;
+                if (length >= 19) prefetch(data + ahead + 2, false);
+                framed[n_framed++ % kLookahead] = ahead;
+                ahead += 2 + length;
+            }
+            if (n_framed == messages) break;
+            if (n_framed - messages > kLookahead / 2) {
+                size_t next = framed[(messages + kLookahead / 2) % kLookahead];
+                if (be16(data + next) >= 19) prefetch(data + next + 2, true);
+            }
+
+            size_t pos = framed[messages % kLookahead];
+            uint16_t length = be16(data + pos);
+            const char* m = data + pos + 2;
+            file.willNeed(pos);
+
+            if (length >= 11) {
+                FeedClock::current = be48(m + 5);
+                if (config.pace > 0.0) {
+                    if (messages == 0) first_ts = FeedClock::current;
+                    auto due = start + std::chrono::nanoseconds(
+                        static_cast<int64_t>((FeedClock::current - first_ts) / config.pace));
+                    while (std::chrono::steady_clock::now() < due) {}
+                }
+            }
+            ++counts[static_cast<uint8_t>(m[0])];
+            apply(m, length);
+            ++messages;
+        }
+
+        elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bytes = ahead;
+    }
+
+    void report() const {
+        std::cout << std::fixed << std::setprecision(0);
+        std::cout << "Replayed " << messages << " messages (" << (bytes >> 20) << " MiB) in " << elapsed_ms
+                  << " ms: " << (messages * 1000.0 / std::max(elapsed_ms, 1e-3)) << " msgs/sec" << std::endl;
+        std::cout << "Adds " << (counts['A'] + counts['F']) << ", executions " << (counts['E'] + counts['C'])
+                  << ", cancels " << counts['X'] << ", deletes " << counts['D'] << ", replaces " << counts['U']
+                  << ", other " << (messages - counts['A'] - counts['F'] - counts['E'] - counts['C']
+                                    - counts['X'] - counts['D'] - counts['U']) << std::endl;
+
+        std::vector<const Stock*> books;
+        uint64_t crossings = 0;
+        for (const auto& stock : stocks) {
+            if (!stock.book) continue;
+            books.push_back(&stock);
+            crossings += stock.book->tradeSink().fills;
+        }
+        std::cout << "Books " << books.size() << ", rejected adds " << rejected_adds << ", unknown order refs "
+                  << unknown_refs << ", crossing fills " << crossings << std::endl << std::endl;
+
+        std::sort(books.begin(), books.end(),
+                  [](const Stock* a, const Stock* b) { return a->messages > b->messages; });
+        if (books.size() > config.top) books.resize(config.top);
+        std::cout << std::left << std::setw(10) << "Symbol" << std::right << std::setw(12) << "Messages"
+                  << std::setw(10) << "Resting" << std::setw(12) << "Best bid" << std::setw(12) << "Best ask"
+                  << std::endl;
+        for (const Stock* stock : books) {
+            const ReplayBook& book = *stock->book;
+            int digits = stock->divisor == 1 ? 4 : 2;
+            std::cout << std::left << std::setw(10) << stock->name << std::right << std::setw(12) << stock->messages
+                      << std::setw(10) << book.getRestingOrders() << std::setprecision(digits)
+                      << std::setw(12) << book.getBestBid() << std::setw(12) << book.getBestAsk()
+                      << std::setprecision(0) << std::endl;
+        }
+    }
+};
+
+/**
+ * @class WireReplayer
+ * @brief Replays a recorded binary-protocol order flow, one OrderBook per symbol
+ *
+ * The file carries no instrument definitions, so a symbol's book is created at
+ * its first new order with a one-cent tick and a ladder centred on that price.
+ */
+class WireReplayer : public MsgHandler {
+private:
+    struct Symbol {
+        std::unique_ptr<OrderBook> book;
+        std::unique_ptr<BookSession<OrderBook>> session;
+        uint64_t messages = 0;
+    };
+
+    ReplayConfig config;
+    std::vector<Symbol> symbols;
+    uint64_t messages = 0;
+    size_t bytes = 0;
+    double elapsed_ms = 0.0;
+
+    Symbol* symbolFor(uint32_t index, Price first_price) {
+        if (index >= symbols.size()) symbols.resize(index + 1);
+        Symbol& symbol = symbols[index];
+        if (!symbol.book && first_price > 0) {
+            Price ladder = std::max<Price>(1000, static_cast<Price>(first_price * config.band));
+            Instrument instrument{"SYM" + std::to_string(index), 0.01, first_price * 0.01, ladder};
+            symbol.book = std::make_unique<OrderBook>(instrument, config.orders_per_book);
+            symbol.session = std::make_unique<BookSession<OrderBook>>(*symbol.book, index);
+        }
+        if (!symbol.book) return nullptr;
+        ++symbol.messages;
+        return &symbol;
+    }
+
+public:
+    explicit WireReplayer(const ReplayConfig& config_) : config(config_) {}
+
+    void onNewOrder(const NewOrderMsg& msg) {
+        if (Symbol* s = symbolFor(msg.symbol, msg.price)) s->session->onNewOrder(msg);
+    }
+
+    void onCancel(const CancelMsg& msg) {
+        if (Symbol* s = symbolFor(msg.symbol, 0)) s->session->onCancel(msg);
+    }
+
+    void onModify(const ModifyMsg& msg) {
+        if (Symbol* s = symbolFor(msg.symbol, 0)) s->session->onModify(msg);
+    }
+
+    void replay(MappedFile& file) {
+        auto start = std::chrono::steady_clock::now();
+        // Decode a window at a time so the readahead hints keep pace with the reader
+        const size_t chunk = 1 << 20;
+        while (bytes < file.size()) {
+            file.willNeed(bytes);
+            size_t available = std::min(chunk, file.size() - bytes);
+            size_t used = decodeMessages(file.data() + bytes, available, *this);
+            if (used == 0) break;  // Truncated or malformed tail
+            bytes += used;
+        }
+        for (const auto& symbol : symbols) messages += symbol.messages;
+        elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report() const {
+        std::cout << std::fixed << std::setprecision(0);
+        std::cout << "Replayed " << messages << " order messages (" << (bytes >> 20) << " MiB) in " << elapsed_ms
+                  << " ms: " << (messages * 1000.0 / std::max(elapsed_ms, 1e-3)) << " msgs/sec" << std::endl
+                  << std::endl;
+        size_t listed = 0;
+        for (size_t i = 0; i < symbols.size() && listed < config.top; ++i) {
+            if (!symbols[i].book) continue;
+            ++listed;
+            std::cout << "SYM" << i << ": " << symbols[i].messages << " messages, ";
+            symbols[i].book->printStats();
+        }
+    }
+};
+
+/**
+ * @brief Write a synthetic ITCH 5.0 day: a directory entry per stock, then adds,
+ *        executions, partial cancels, deletes and replaces against uncrossed books
+ *
+ * Each stock keeps a fixed mid price; bids rest below it and asks above, so the
+ * rebuilt books never cross. Like a real feed, adds and deletes dominate, a
+ * stock's resting orders stay bounded (kMaxLive), and activity is skewed: stocks are
+ * drawn with Zipf weights and most executions, cancels and replaces hit one of
+ * a stock's most recent orders; `uniform` turns both skews off (worst case for
+ * the book's caches).
+ */
+static bool generateItch(const std::string& path, uint64_t n_messages, uint32_t n_stocks, bool uniform) {
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+
+    struct Live { uint64_t ref; uint32_t shares; uint32_t price; char side; };
+    const size_t kMaxLive = 2000;  // Resting orders per stock before adds turn into deletes
+    std::vector<std::vector<Live>> live(n_stocks);
+    std::vector<uint32_t> mid(n_stocks);
+    std::mt19937_64 rng(2024);
+
+    std::vector<double> weights(n_stocks, 1.0);
+    if (!uniform) {
+        for (uint32_t s = 0; s < n_stocks; ++s) weights[s] = 1.0 / (s + 1);
+    }
+    std::discrete_distribution<uint32_t> stock_dist(weights.begin(), weights.end());
+
+    std::string buf;
+    uint64_t ts = 34200ULL * 1000000000ULL;  // 09:30:00
+    uint64_t next_ref = 1;
+    auto frame = [&](std::string& msg) {
+        put16(buf, static_cast<uint16_t>(msg.size()));
+        buf += msg;
+        if (buf.size() > (1 << 20)) {
+            std::fwrite(buf.data(), 1, buf.size(), out);
+            buf.clear();
+        }
+    };
+    auto header = [&](char type, uint16_t locate) {
+        std::string msg(1, type);
+        put16(msg, locate);
+        put16(msg, 0);  // Tracking number
+        ts += 1 + rng() % 2000;
+        put48(msg, ts);
+        return msg;
+    };
+
+    for (uint32_t s = 0; s < n_stocks; ++s) {
+        mid[s] = static_cast<uint32_t>(10 + rng() % 490) * 10000;  // $10 - $500
+        std::string msg = header('R', static_cast<uint16_t>(s + 1));
+        char name[9];
+        std::snprintf(name, sizeof(name), "S%-7u", s + 1);
+        msg.append(name, 8);
+        msg.append(20, '\0');  // Market category through inverse indicator
+        frame(msg);
+    }
+
+    for (uint64_t i = 0; i < n_messages; ++i) {
+        uint32_t s = stock_dist(rng);
+        uint16_t locate = static_cast<uint16_t>(s + 1);
+        std::vector<Live>& orders = live[s];
+        // Message mix of a typical equity feed: mostly adds and deletes
+        unsigned action = rng() % 100;
+        if (action < 45 && orders.size() >= kMaxLive) action = 60;
+
+        if (orders.empty() || action < 45) {
+            Live order;
+            order.ref = next_ref++;
+            order.side = (rng() & 1) ? 'B' : 'S';
+            uint32_t offset = static_cast<uint32_t>(1 + rng() % 50) * 100;
+            order.price = order.side == 'B' ? mid[s] - offset : mid[s] + offset;
+            order.shares = static_cast<uint32_t>(1 + rng() % 10) * 100;
+            std::string msg = header('A', locate);
+            put64(msg, order.ref);
+            msg += order.side;
+            put32(msg, order.shares);
+            msg.append("S       ", 8);
+            put32(msg, order.price);
+            frame(msg);
+            orders.push_back(order);
+            continue;
+        }
+
+        size_t recent = std::min<size_t>(orders.size(), 32);
+        size_t k = (uniform || rng() % 4 == 0) ? rng() % orders.size() : orders.size() - 1 - rng() % recent;
+        Live& order = orders[k];
+        if (action < 53) {
+            // Execution (E) or partial cancel (X) of part or all of the order
+            uint32_t shares = std::min<uint32_t>(order.shares, static_cast<uint32_t>(1 + rng() % 5) * 100);
+            std::string msg = header(action < 50 ? 'E' : 'X', locate);
+            put64(msg, order.ref);
+            put32(msg, shares);
+            if (action < 50) put64(msg, i);  // Match number
+            frame(msg);
+            order.shares -= shares;
+        } else if (action < 90) {
+            std::string msg = header('D', locate);
+            put64(msg, order.ref);
+            frame(msg);
+            order.shares = 0;
+        } else {
+            uint64_t new_ref = next_ref++;
+            uint32_t offset = static_cast<uint32_t>(1 + rng() % 50) * 100;
+            uint32_t price = order.side == 'B' ? mid[s] - offset : mid[s] + offset;
+            uint32_t shares = static_cast<uint32_t>(1 + rng() % 10) * 100;
+            std::string msg = header('U', locate);
+            put64(msg, order.ref);
+            put64(msg, new_ref);
+            put32(msg, shares);
+            put32(msg, price);
+            frame(msg);
+            order = {new_ref, shares, price, order.side};
+        }
+        if (order.shares == 0) {
+            order = orders.back();
+            orders.pop_back();
+        }
+    }
+
+    std::fwrite(buf.data(), 1, buf.size(), out);
+    return std::fclose(out) == 0;
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) end = list.size();
+        if (end > begin) items.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  replay FILE [--pace SPEED] [--symbols A,B] [--band FRACTION] [--orders-per-book N] [--top N]\n"
+              << "  replay --wire FILE [--orders-per-book N] [--top N]\n"
+              << "  replay --generate FILE [--messages N] [--stocks N] [--uniform]\n";
+}
+
+int main(int argc, char** argv) {
+    ReplayConfig config;
+    std::string path, generate_path;
+    bool wire = false;
+    uint64_t n_messages = 10000000;
+    uint32_t n_stocks = 500;
+    bool uniform = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--pace" && has_value) config.pace = std::atof(argv[++i]);
+        else if (arg == "--symbols" && has_value) config.symbols = splitList(argv[++i]);
+        else if (arg == "--band" && has_value) config.band = std::atof(argv[++i]);
+        else if (arg == "--orders-per-book" && has_value) config.orders_per_book = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--top" && has_value) config.top = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--generate" && has_value) generate_path = argv[++i];
+        else if (arg == "--messages" && has_value) n_messages = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--stocks" && has_value) n_stocks = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--uniform") uniform = true;
+        else if (arg == "--wire" && has_value) { wire = true; path = argv[++i]; }
+        else if (!arg.empty() && arg[0] != '-' && path.empty()) path = arg;
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!generate_path.empty()) {
+        if (n_stocks == 0 || n_stocks > 65535) {
+            std::cerr << "--stocks must be between 1 and 65535" << std::endl;
+            return 1;
+        }
+        if (!generateItch(generate_path, n_messages, n_stocks, uniform)) {
+            std::perror(generate_path.c_str());
+            return 1;
+        }
+        std::cout << "Wrote " << n_messages << " synthetic ITCH messages for " << n_stocks << " stocks to "
+                  << generate_path << std::endl;
+        return 0;
+    }
+    if (path.empty()) {
+        usage();
+        return 1;
+    }
+
+    MappedFile file;
+    if (!file.open(path)) {
+        std::perror(path.c_str());
+        return 1;
+    }
+
+    if (wire) {
+        auto replayer = std::make_unique<WireReplayer>(config);
+        replayer->replay(file);
+        replayer->report();
+    } else {
+        auto replayer = std::make_unique<ItchReplayer>(config);
+        double sizing_ms = replayer->size(file);
+        std::cout << std::fixed << std::setprecision(0) << "Sizing pass: " << sizing_ms << " ms" << std::endl;
+        replayer->replay(file);
+        replayer->report();
+    }
+    return 0;
+}
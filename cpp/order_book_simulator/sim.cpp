@@ -0,0 +1,603 @@
+/**
+ * @file sim.cpp
+ * @brief Agent-based market simulator: populations of trading agents driving OrderBook, many days in parallel
+ *
+ * Each simulated trading day is an independent replica: one book, one agent
+ * population and an event-driven scheduler. Agents sleep until their next
+ * wake-up, popped in time order from a priority queue. On waking, an agent
+ * reads the book, sends adds, cancels or modifies through the normal API and
+ * draws its next wake-up. Nothing runs between wake-ups, so a day costs
+ * O(events), however long the session.
+ *
+ * Agents:
+ * - noise: random limit orders around the mid (and some market orders), cancelling the oldest
+ * - market maker: two-sided quotes around the mid, skewed against inventory
+ * - momentum: trades with the gap between a fast and a slow moving average
+ * - mean reversion: trades against the gap between the price and a slow moving average
+ * - informed: sees a latent fundamental value (a random walk) and takes liquidity when the book strays from it
+ *
+ * Positions and cash come from the book's RiskTable, one account per agent,
+ * whose position limits also cap each agent's inventory. The book's clock is
+ * the simulation clock, and self-trade prevention keeps market makers from
+ * trading with their own quotes.
+ *
+ * Days run on a pool of threads, one replica at a time per thread. Day i is
+ * seeded from (seed, i) alone, so results are identical for any thread count.
+ *
+ * Usage:
+ *   ./sim [--days N] [--threads N] [--seed N] [--hours H] [--csv PATH] [--verify]
+ *
+ * Compile: g++ -std=c++17 -O3 -pthread -o sim sim.cpp
+ */
+
+#include "orderbook.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+enum class AgentKind : uint8_t {
+    NOISE,
+    MARKET_MAKER,
+    MOMENTUM,
+    MEAN_REVERSION,
+    INFORMED,
+    COUNT
+};
+
+constexpr size_t kAgentKinds = static_cast<size_t>(AgentKind::COUNT);
+constexpr const char* kAgentNames[kAgentKinds] = {"noise", "market maker", "momentum", "mean reversion", "informed"};
+
+/**
+ * @struct SimConfig
+ * @brief Session length, agent population and per-kind behaviour of a simulated day
+ *
+ * Wake-ups are exponential with the given mean, so each agent wakes as a
+ * Poisson process. Distances and thresholds are in ticks; sizes in shares.
+ */
+struct SimConfig {
+    double session_hours = 6.5;
+
+    uint32_t agents[kAgentKinds] = {60, 4, 10, 10, 8};        // Population by AgentKind
+    double wake_ms[kAgentKinds] = {2000, 200, 5000, 5000, 2000};
+    int64_t max_position[kAgentKinds] = {20000, 5000, 3000, 3000, 50000};
+
+    double noise_market = 0.15;        // Fraction of noise wake-ups that send a market order
+    double noise_cancel = 0.3;         // Chance a noise agent cancels its oldest order on waking
+    double noise_depth = 4.0;          // Mean distance of a noise limit order from the mid (geometric)
+    uint32_t noise_max_orders = 8;     // Resting orders a noise agent keeps before cancelling the oldest
+    uint32_t noise_max_lots = 10;      // Noise order size: 1 to this many lots of 100
+
+    double mm_half_spread = 1.5;       // Quote distance from the mid
+    double mm_skew = 3.0;              // Quote shift, in ticks, at the inventory limit
+    uint64_t mm_size = 500;
+
+    double momentum_fast = 0.3;        // Moving-average weights per wake-up
+    double momentum_slow = 0.05;
+    double momentum_threshold = 1.0;
+    uint64_t momentum_size = 300;
+
+    double reversion_weight = 0.02;
+    double reversion_threshold = 2.0;
+    uint64_t reversion_size = 300;
+
+    double fundamental_vol = 0.015;    // Daily volatility of the fundamental value
+    double informed_threshold = 2.0;   // Mispricing an informed agent needs before trading
+    uint64_t informed_size = 300;
+};
+
+/**
+ * @struct SimClock
+ * @brief Timestamp policy reading the running replica's simulated time (ns from the open)
+ *
+ * Thread-local, since each thread runs one replica at a time.
+ */
+struct SimClock {
+    static thread_local uint64_t sim_ns;
+    uint64_t now() const { return sim_ns; }
+};
+
+thread_local uint64_t SimClock::sim_ns = 0;
+
+/**
+ * @struct DayTape
+ * @brief Trade sink keeping the day's volume, OHLC and one-minute closing prices
+ */
+struct DayTape {
+    static constexpr uint64_t kMinuteNs = 60000000000ULL;
+
+    uint64_t trades = 0;
+    uint64_t volume = 0;
+    int64_t notional = 0;  // Ticks x shares
+    Price open = 0;
+    Price high = 0;
+    Price low = 0;
+    Price close = 0;
+    std::vector<Price> minute_close;  // 0 for minutes without a trade
+
+    explicit DayTape(size_t minutes) : minute_close(minutes, 0) {}
+
+    void onTrade(const Trade& trade) {
+        ++trades;
+        volume += trade.quantity;
+        notional += trade.price * static_cast<int64_t>(trade.quantity);
+        if (open == 0) open = high = low = trade.price;
+        high = std::max(high, trade.price);
+        low = std::min(low, trade.price);
+        close = trade.price;
+        size_t minute = trade.timestamp / kMinuteNs;
+        if (minute < minute_close.size()) minute_close[minute] = trade.price;
+    }
+
+    // Standard deviation of one-minute log returns scaled to the session, in percent
+    double realizedVol() const {
+        double last = 0.0, sum = 0.0, sum_sq = 0.0;
+        size_t n = 0;
+        for (Price p : minute_close) {
+            if (p == 0) continue;  // Carry the last close through quiet minutes
+            if (last > 0.0) {
+                double r = std::log(p / last);
+                sum += r;
+                sum_sq += r * r;
+                ++n;
+            }
+            last = static_cast<double>(p);
+        }
+        if (n < 2) return 0.0;
+        double var = (sum_sq - sum * sum / n) / (n - 1);
+        return 100.0 * std::sqrt(var * minute_close.size());
+    }
+};
+
+/**
+ * @struct DayResult
+ * @brief Outcome of one simulated day
+ */
+struct DayResult {
+    uint64_t seed = 0;
+    uint64_t events = 0;            // Agent wake-ups
+    uint64_t trades = 0;
+    uint64_t volume = 0;
+    uint64_t rejected = 0;          // Orders the book refused, mostly at position limits
+    double open = 0.0;
+    double close = 0.0;
+    double vwap = 0.0;
+    double high = 0.0;
+    double low = 0.0;
+    double realized_vol = 0.0;      // Percent over the session
+    double fundamental = 0.0;       // Fundamental value at the close
+    double pnl[kAgentKinds] = {};   // Mean per agent of the kind, marked at the close, in dollars
+
+    // Order-sensitive hash of the result, for comparing runs
+    uint64_t digest() const {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        auto mix = [&](uint64_t v) {
+            for (int i = 0; i < 8; ++i) {
+                h ^= (v >> (8 * i)) & 0xff;
+                h *= 0x100000001b3ULL;
+            }
+        };
+        mix(events);
+        mix(trades);
+        mix(volume);
+        mix(rejected);
+        mix(static_cast<uint64_t>(std::llround(close * 100)));
+        for (double p : pnl) mix(static_cast<uint64_t>(std::llround(p * 100)));
+        return h;
+    }
+};
+
+/**
+ * @class MarketSimulation
+ * @brief One simulated day: a book, the agents and their wake-up queue
+ */
+class MarketSimulation {
+private:
+    using Book = BasicOrderBook<SimClock, DayTape, DenseIdHash, NullDepthSink, NullLatency, RiskTable>;
+
+    struct Agent {
+        AgentKind kind;
+        uint32_t account;               // RiskTable account, also the self-trade owner (never 0)
+        std::vector<uint64_t> orders;   // Noise: own resting orders, oldest first
+        uint64_t bid_id = 0;            // Market maker: current quotes
+        uint64_t ask_id = 0;
+        double fast = 0.0;              // Moving averages of the mid; 0 before the first wake-up
+        double slow = 0.0;
+    };
+
+    // Wake-ups pop earliest first, ties by agent index, so the order of events is fixed by the seed
+    struct Wakeup {
+        uint64_t time;
+        uint32_t agent;
+
+        bool operator>(const Wakeup& other) const {
+            return time != other.time ? time > other.time : agent > other.agent;
+        }
+    };
+
+    const SimConfig& config;
+    const Instrument& instrument;
+    std::mt19937_64 rng;
+    uint64_t session_ns;
+    Book book;
+    std::vector<Agent> agents;
+    std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> wakeups;
+    Price reference;
+    Price min_price;
+    Price max_price;
+    double fundamental;        // Ticks
+    uint64_t fundamental_ns = 0;
+    uint64_t rejected = 0;
+
+    double uniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(rng); }
+
+    void schedule(uint32_t agent, uint64_t now) {
+        double mean_ns = config.wake_ms[static_cast<size_t>(agents[agent].kind)] * 1e6;
+        uint64_t delay = static_cast<uint64_t>(std::exponential_distribution<double>(1.0 / mean_ns)(rng));
+        wakeups.push({now + delay + 1, agent});
+    }
+
+    // Mid in ticks, falling back to one side, the last trade, then the reference price
+    double mid() const {
+        Price bid = book.getBestBidTicks();
+        Price ask = book.getBestAskTicks();
+        if (bid && ask) return 0.5 * static_cast<double>(bid + ask);
+        if (bid || ask) return static_cast<double>(bid ? bid : ask);
+        Price last = book.getLastTradeTicks();
+        return static_cast<double>(last ? last : reference);
+    }
+
+    // A passive price `distance` ticks from `center` on `side`'s own side, rounded away from it,
+    // so that neither side is favoured by rounding
+    static Price behind(Side side, double center, double distance) {
+        return side == Side::BUY ? static_cast<Price>(std::floor(center - distance))
+                                 : static_cast<Price>(std::ceil(center + distance));
+    }
+
+    // Fundamental value at `now`: a driftless geometric random walk advanced lazily
+    double fundamentalAt(uint64_t now) {
+        double dt = static_cast<double>(now - fundamental_ns) / static_cast<double>(session_ns);
+        double sigma = config.fundamental_vol * std::sqrt(dt);
+        fundamental *= std::exp(sigma * std::normal_distribution<double>(0.0, 1.0)(rng) - 0.5 * sigma * sigma);
+        fundamental_ns = now;
+        return fundamental;
+    }
+
+    int64_t position(const Agent& agent) const { return book.risk().account(agent.account).position; }
+
+    uint64_t send(const Agent& agent, Side side, OrderType type, Price price, uint64_t quantity) {
+        OrderOptions options;
+        options.account = agent.account;
+        price = std::clamp(price, min_price, max_price);
+        uint64_t id = book.addOrderTicks(side, type, price, quantity, options);
+        if (!id) ++rejected;
+        return id;
+    }
+
+    void noise(Agent& agent) {
+        agent.orders.erase(std::remove_if(agent.orders.begin(), agent.orders.end(),
+                                          [&](uint64_t id) { return !book.findOrder(id); }),
+                           agent.orders.end());
+        if (!agent.orders.empty() &&
+            (agent.orders.size() >= config.noise_max_orders || uniform() < config.noise_cancel)) {
+            book.cancelOrder(agent.orders.front());
+            agent.orders.erase(agent.orders.begin());
+        }
+
+        Side side = (rng() & 1) ? Side::BUY : Side::SELL;
+        uint64_t quantity = 100 * (1 + rng() % config.noise_max_lots);
+        if (uniform() < config.noise_market) {
+            send(agent, side, OrderType::MARKET, 0, quantity);
+            return;
+        }
+        Price offset = std::geometric_distribution<Price>(1.0 / (1.0 + config.noise_depth))(rng);
+        uint64_t id = send(agent, side, OrderType::LIMIT, behind(side, mid(), static_cast<double>(offset)), quantity);
+        if (id && book.findOrder(id)) agent.orders.push_back(id);
+    }
+
+    // Keep one quote at `price`, repricing it in place; none when `allowed` is false
+    void quote(const Agent& agent, uint64_t& id, Side side, Price price, bool allowed) {
+        const Order* resting = id ? book.findOrder(id) : nullptr;
+        if (!allowed) {
+            if (resting) book.cancelOrder(id);
+            id = 0;
+        } else if (!resting) {
+            id = send(agent, side, OrderType::LIMIT, price, config.mm_size);
+        } else if (resting->price != price) {
+            book.modifyOrderTicks(id, price, config.mm_size);
+        }
+    }
+
+    void marketMaker(Agent& agent) {
+        int64_t limit = config.max_position[static_cast<size_t>(AgentKind::MARKET_MAKER)];
+        int64_t pos = position(agent);
+        double center = mid() - config.mm_skew * static_cast<double>(pos) / static_cast<double>(limit);
+        quote(agent, agent.bid_id, Side::BUY, behind(Side::BUY, center, config.mm_half_spread), pos < limit);
+        quote(agent, agent.ask_id, Side::SELL, behind(Side::SELL, center, config.mm_half_spread), pos > -limit);
+    }
+
+    void momentum(Agent& agent) {
+        double m = mid();
+        if (agent.slow == 0.0) agent.fast = agent.slow = m;
+        agent.fast += config.momentum_fast * (m - agent.fast);
+        agent.slow += config.momentum_slow * (m - agent.slow);
+        double signal = agent.fast - agent.slow;
+        if (signal > config.momentum_threshold) {
+            send(agent, Side::BUY, OrderType::MARKET, 0, config.momentum_size);
+        } else if (signal < -config.momentum_threshold) {
+            send(agent, Side::SELL, OrderType::MARKET, 0, config.momentum_size);
+        }
+    }
+
+    void meanReversion(Agent& agent) {
+        double m = mid();
+        if (agent.slow == 0.0) agent.slow = m;
+        agent.slow += config.reversion_weight * (m - agent.slow);
+        double gap = m - agent.slow;
+        Price bid = book.getBestBidTicks();
+        Price ask = book.getBestAskTicks();
+        if (gap > config.reversion_threshold && bid) {
+            send(agent, Side::SELL, OrderType::IOC, bid, config.reversion_size);
+        } else if (gap < -config.reversion_threshold && ask) {
+            send(agent, Side::BUY, OrderType::IOC, ask, config.reversion_size);
+        }
+    }
+
+    // Take whatever is mispriced by more than the threshold, up to a limit that keeps the edge
+    void informed(Agent& agent, uint64_t now) {
+        double value = fundamentalAt(now);
+        Price bid = book.getBestBidTicks();
+        Price ask = book.getBestAskTicks();
+        double edge = config.informed_threshold;
+        if (ask && value - ask > edge) {
+            send(agent, Side::BUY, OrderType::IOC, static_cast<Price>(std::floor(value - edge)), config.informed_size);
+        } else if (bid && bid - value > edge) {
+            send(agent, Side::SELL, OrderType::IOC, static_cast<Price>(std::ceil(value + edge)), config.informed_size);
+        }
+    }
+
+    void act(Agent& agent, uint64_t now) {
+        switch (agent.kind) {
+            case AgentKind::NOISE: noise(agent); break;
+            case AgentKind::MARKET_MAKER: marketMaker(agent); break;
+            case AgentKind::MOMENTUM: momentum(agent); break;
+            case AgentKind::MEAN_REVERSION: meanReversion(agent); break;
+            default: informed(agent, now); break;
+        }
+    }
+
+public:
+    MarketSimulation(const SimConfig& config_, const Instrument& instrument_, uint64_t seed)
+        : config(config_),
+          instrument(instrument_),
+          rng(seed),
+          session_ns(static_cast<uint64_t>(config_.session_hours * 3600e9)),
+          book(instrument_, 1 << 16, static_cast<size_t>(session_ns / DayTape::kMinuteNs) + 1),
+          reference(instrument_.toTicks(instrument_.reference_price)),
+          min_price(reference - instrument_.ladder_ticks),
+          max_price(reference + instrument_.ladder_ticks),
+          fundamental(static_cast<double>(reference)) {
+        book.setSelfTradePrevention(SelfTradePrevention::CANCEL_RESTING);
+        for (size_t k = 0; k < kAgentKinds; ++k) {
+            RiskLimits limits;
+            limits.max_position = config.max_position[k];
+            for (uint32_t i = 0; i < config.agents[k]; ++i) {
+                Agent agent;
+                agent.kind = static_cast<AgentKind>(k);
+                agent.account = static_cast<uint32_t>(agents.size()) + 1;
+                book.risk().setLimits(agent.account, limits);
+                agents.push_back(std::move(agent));
+            }
+        }
+    }
+
+    /**
+     * @brief Run the session from the open to the close
+     */
+    DayResult run() {
+        SimClock::sim_ns = 0;
+        for (uint32_t i = 0; i < agents.size(); ++i) schedule(i, 0);
+
+        DayResult result;
+        while (!wakeups.empty() && wakeups.top().time < session_ns) {
+            Wakeup wakeup = wakeups.top();
+            wakeups.pop();
+            SimClock::sim_ns = wakeup.time;
+            act(agents[wakeup.agent], wakeup.time);
+            schedule(wakeup.agent, wakeup.time);
+            ++result.events;
+        }
+
+        const DayTape& tape = book.tradeSink();
+        Price mark = tape.close ? tape.close : static_cast<Price>(std::llround(mid()));
+        result.trades = tape.trades;
+        result.volume = tape.volume;
+        result.rejected = rejected;
+        result.open = instrument.toPrice(tape.open);
+        result.close = instrument.toPrice(mark);
+        result.high = instrument.toPrice(tape.high);
+        result.low = instrument.toPrice(tape.low);
+        result.vwap = tape.volume ? instrument.tick_size * static_cast<double>(tape.notional) / tape.volume : 0.0;
+        result.realized_vol = tape.realizedVol();
+        result.fundamental = instrument.tick_size * fundamentalAt(session_ns);
+        for (const Agent& agent : agents) {
+            const RiskAccount& account = book.risk().account(agent.account);
+            double pnl = instrument.tick_size * static_cast<double>(account.position * mark - account.cash);
+            result.pnl[static_cast<size_t>(agent.kind)] += pnl / config.agents[static_cast<size_t>(agent.kind)];
+        }
+        return result;
+    }
+};
+
+// Day `day`'s seed: splitmix64 of the base seed and the day index
+static uint64_t replicaSeed(uint64_t seed, uint64_t day) {
+    uint64_t z = seed + (day + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Simulate days [0, days) on `threads` threads pinned one per core, each taking the next unrun day
+ */
+static std::vector<DayResult> runDays(const SimConfig& config, const Instrument& instrument, size_t days,
+                                      uint64_t seed, unsigned threads) {
+    std::vector<DayResult> results(days);
+    std::atomic<size_t> next_day{0};
+    std::vector<std::thread> workers;
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            for (size_t day = next_day++; day < days; day = next_day++) {
+                uint64_t day_seed = replicaSeed(seed, day);
+                MarketSimulation simulation(config, instrument, day_seed);
+                results[day] = simulation.run();
+                results[day].seed = day_seed;
+            }
+        });
+        pinThread(workers.back(), t % cores);
+    }
+    for (auto& worker : workers) worker.join();
+    return results;
+}
+
+static void printSummary(const SimConfig& config, const std::vector<DayResult>& results) {
+    size_t n = results.size();
+    auto mean_sd = [&](auto field, double& mean, double& sd) {
+        mean = sd = 0.0;
+        for (const auto& r : results) mean += field(r);
+        mean /= n;
+        for (const auto& r : results) sd += (field(r) - mean) * (field(r) - mean);
+        sd = n > 1 ? std::sqrt(sd / (n - 1)) : 0.0;
+    };
+    double mean, sd;
+
+    std::cout << std::fixed << std::setprecision(0) << "Per day (mean +/- sd):" << std::endl;
+    mean_sd([](const DayResult& r) { return static_cast<double>(r.events); }, mean, sd);
+    std::cout << "  Agent wake-ups:   " << mean << " +/- " << sd << std::endl;
+    mean_sd([](const DayResult& r) { return static_cast<double>(r.trades); }, mean, sd);
+    std::cout << "  Trades:           " << mean << " +/- " << sd << std::endl;
+    mean_sd([](const DayResult& r) { return static_cast<double>(r.volume); }, mean, sd);
+    std::cout << "  Volume:           " << mean << " +/- " << sd << std::endl;
+    mean_sd([](const DayResult& r) { return static_cast<double>(r.rejected); }, mean, sd);
+    std::cout << "  Rejected orders:  " << mean << " +/- " << sd << std::endl;
+    std::cout << std::setprecision(2);
+    mean_sd([](const DayResult& r) { return 100.0 * (r.close / r.open - 1.0); }, mean, sd);
+    std::cout << "  Open-to-close:    " << mean << "% +/- " << sd << "%" << std::endl;
+    mean_sd([](const DayResult& r) { return r.realized_vol; }, mean, sd);
+    std::cout << "  Realized vol:     " << mean << "% +/- " << sd << "% (1-minute returns)" << std::endl;
+    mean_sd([](const DayResult& r) { return 100.0 * (r.close / r.fundamental - 1.0); }, mean, sd);
+    std::cout << "  Close vs value:   " << mean << "% +/- " << sd << "%" << std::endl;
+
+    std::cout << "P&L per agent per day ($, marked at the close):" << std::endl;
+    for (size_t k = 0; k < kAgentKinds; ++k) {
+        if (config.agents[k] == 0) continue;
+        mean_sd([k](const DayResult& r) { return r.pnl[k]; }, mean, sd);
+        std::cout << "  " << std::left << std::setw(16) << kAgentNames[k] << std::right << std::setw(10) << mean
+                  << " +/- " << sd << "  (" << config.agents[k] << " agents)" << std::endl;
+    }
+}
+
+static void writeCsv(const std::string& path, const std::vector<DayResult>& results) {
+    std::ofstream csv(path);
+    csv << "day,seed,events,trades,volume,rejected,open,high,low,close,vwap,realized_vol,fundamental";
+    for (std::string name : kAgentNames) {
+        std::replace(name.begin(), name.end(), ' ', '_');
+        csv << ",pnl_" << name;
+    }
+    csv << "\n" << std::setprecision(10);
+    for (size_t d = 0; d < results.size(); ++d) {
+        const DayResult& r = results[d];
+        csv << d << "," << r.seed << "," << r.events << "," << r.trades << "," << r.volume << "," << r.rejected
+            << "," << r.open << "," << r.high << "," << r.low << "," << r.close << "," << r.vwap << ","
+            << r.realized_vol << "," << r.fundamental;
+        for (double p : r.pnl) csv << "," << p;
+        csv << "\n";
+    }
+}
+
+static void usage() {
+    std::cerr << "Usage:\n"
+              << "  sim [--days N] [--threads N] [--seed N] [--hours H] [--csv PATH] [--verify]\n";
+}
+
+int main(int argc, char** argv) {
+    SimConfig config;
+    size_t days = 64;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t seed = 42;
+    std::string csv_path;
+    bool verify = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--days" && has_value) days = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && has_value) threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--seed" && has_value) seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--hours" && has_value) config.session_hours = std::atof(argv[++i]);
+        else if (arg == "--csv" && has_value) csv_path = argv[++i];
+        else if (arg == "--verify") verify = true;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (days == 0 || config.session_hours <= 0.0) {
+        usage();
+        return 1;
+    }
+
+    Instrument instrument{"SIM", 0.01, 100.00, 2000};
+    std::cout << "=== Agent-Based Simulation ===" << std::endl;
+    std::cout << days << " days of " << config.session_hours << " h, agents:";
+    for (size_t k = 0; k < kAgentKinds; ++k) std::cout << " " << config.agents[k] << " " << kAgentNames[k] << ",";
+    std::cout << " seed " << seed << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<DayResult> results = runDays(config, instrument, days, seed, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t events = 0;
+    uint64_t digest = 0;
+    for (const auto& r : results) {
+        events += r.events;
+        digest = digest * 31 + r.digest();
+    }
+    std::cout << std::fixed << std::setprecision(1) << "Wall time " << seconds << " s on " << threads
+              << " thread(s): " << std::setprecision(0) << (days * 3600.0 / seconds) << " days/hour, "
+              << (events / seconds) << " agent wake-ups/sec" << std::endl;
+    printSummary(config, results);
+    std::cout << "Digest: " << std::hex << digest << std::dec << " (the same for any --threads)" << std::endl;
+
+    // Re-run a few days on one thread: each must reproduce exactly
+    if (verify) {
+        size_t n = std::min<size_t>(days, 4);
+        std::vector<DayResult> again = runDays(config, instrument, n, seed, 1);
+        bool same = true;
+        for (size_t d = 0; d < n; ++d) same = same && again[d].digest() == results[d].digest();
+        std::cout << "Single-thread re-run of " << n << " days: " << (same ? "identical" : "MISMATCH") << std::endl;
+        if (!same) return 1;
+    }
+
+    if (!csv_path.empty()) {
+        writeCsv(csv_path, results);
+        std::cout << "Per-day results written to " << csv_path << std::endl;
+    }
+    return 0;
+}